@@ -7,10 +7,17 @@
 #include <stdint.h>
 #include <stdlib.h>
 #include <jpeglib.h>
+#include "stats.h"
+#include "jpeg.h"
 
 int bmp_to_jpeg(const char *source, const char *dest);
 int jpeg_to_bmp(const char *source, const char *dest);
+int bmp_to_jpeg_with_stats(const char *source, const char *dest, ImageStats *stats);
+int jpeg_to_bmp_with_stats(const char *source, const char *dest, ImageStats *stats);
 int duplicate_bmp_file(const char *source, const char *dest);
 int duplicate_jpeg_file(const char *source, const char *dest);
+int transform_jpeg_file(const char *source, const char *dest, JpegTransform transform, int trim);
+int auto_level_jpeg_file(const char *source, const char *dest, double clipPercent);
+int jpeg_pyramid(const char *source, const int *sizes, const char **dests, int count);
 
 #endif
\ No newline at end of file
@@ -8,9 +8,39 @@
 #include <stdlib.h>
 #include <stdio.h>
 #include <jpeglib.h>
+#include "stats.h"
+#include "ycbcr.h"
+
+/* JPEG file being written from YCbCr 4:2:0 planes one iMCU row at a time (see compress_ycbcr_begin) */
+typedef struct {
+    struct jpeg_compress_struct cinfo;
+    struct jpeg_error_mgr       jerr;
+    FILE                       *outfile;
+} YCbCrWriter;
+
+/* Lossless transforms applied to DCT coefficient blocks (see transform_jpeg) */
+typedef enum {
+    JPEG_TRANSFORM_NONE,        // copy coefficients unchanged
+    JPEG_TRANSFORM_FLIP_H,      // mirror left-right
+    JPEG_TRANSFORM_FLIP_V,      // mirror top-bottom
+    JPEG_TRANSFORM_TRANSPOSE,   // mirror across the top-left to bottom-right diagonal
+    JPEG_TRANSFORM_TRANSVERSE,  // mirror across the top-right to bottom-left diagonal
+    JPEG_TRANSFORM_ROT_90,      // rotate 90 degrees clockwise
+    JPEG_TRANSFORM_ROT_180,
+    JPEG_TRANSFORM_ROT_270
+} JpegTransform;
 
 
 int decompress_jpeg(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components);
+int decompress_jpeg_with_stats(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components, ImageStats *stats);
+int decompress_jpeg_scaled(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components, int minSize);
 int compress_jpeg(const char *filename, unsigned char *image_buffer, int width, int height, int input_components, int in_color_space);
+int compress_jpeg_ycbcr(const char *filename, const YCbCrImage *img);
+int compress_ycbcr_begin(YCbCrWriter *writer, const char *filename, int width, int height);
+int compress_ycbcr_rows(YCbCrWriter *writer, const YCbCrImage *img);
+int compress_ycbcr_finish(YCbCrWriter *writer);
+void compress_ycbcr_abort(YCbCrWriter *writer);
+int decompress_jpeg_ycbcr(const char *filename, YCbCrImage *img);
+int transform_jpeg(const char *source, const char *dest, JpegTransform transform, int trim);
 
 #endif
\ No newline at end of file
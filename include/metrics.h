@@ -0,0 +1,57 @@
+/* metrics.h */
+
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define METRICS_MAX_SCALES      5       // MS-SSIM scales (each half the size of the previous)
+#define METRICS_MIN_DIMENSION   8       // one SSIM window
+
+/* Result of comparing two images */
+typedef struct {
+    double mse;         // mean squared error over every channel
+    double psnr;        // peak signal-to-noise ratio in dB (INFINITY for identical images)
+    double ssim;        // structural similarity of luma, 8x8 windows with a 4 pixel step
+    double msSsim;      // multi-scale structural similarity of luma
+} ImageQuality;
+
+/* Running state of one MS-SSIM scale --- luma is reduced to 4x4 block sums as rows arrive */
+typedef struct {
+    int      width;
+    int      blocksWide;
+    int      rowsBuffered;      // rows of the current block row held in lumaA/lumaB
+    int      blockRow;          // index (in this scale) of the next block row to complete
+    uint8_t *lumaA;             // 4 rows
+    uint8_t *lumaB;
+    int32_t *sums;              // 2 block rows (alternating previous/current) of 5 sums per block
+    double   ssimSum;
+    double   csSum;
+    uint64_t windows;
+} CompareScale;
+
+/* Running state of a streaming comparison (see compare_begin) */
+typedef struct {
+    int          width;
+    int          height;
+    int          components;
+    int          scales;
+    int          rowsFed;
+    int          rowOffset;         // image row of the first row fed (non-zero for bands)
+    int          firstCountedRow;   // rows and windows above this image row are context only
+    uint64_t     sqErr;
+    uint64_t     samples;
+    CompareScale scale[METRICS_MAX_SCALES];
+} ImageCompare;
+
+int compare_begin(ImageCompare *cmp, int width, int height, int components);
+int compare_rows(ImageCompare *cmp, const uint8_t *rowsA, const uint8_t *rowsB, int numRows);
+int compare_finish(ImageCompare *cmp, ImageQuality *quality);
+int compare_image_buffers(const uint8_t *imageA, const uint8_t *imageB, int width, int height, int components, ImageQuality *quality);
+int compare_image_files(const char *fileA, const char *fileB, ImageQuality *quality);
+
+#endif
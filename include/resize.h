@@ -0,0 +1,15 @@
+/* resize.h */
+
+#ifndef RESIZE_H
+#define RESIZE_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+int downscale_2x(const uint8_t *src, int width, int height, int components, uint8_t *dst);
+int resize_area(const uint8_t *src, int srcWidth, int srcHeight, int components, uint8_t *dst, int dstWidth, int dstHeight);
+
+#endif
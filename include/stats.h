@@ -0,0 +1,40 @@
+/* stats.h */
+
+#ifndef STATS_H
+#define STATS_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define STATS_MAX_CHANNELS      3       // RGB or grayscale
+#define STATS_SUBHISTOGRAMS     4       // consecutive pixels land in different copies to avoid store-forwarding stalls
+
+/* Per-channel statistics of an image --- channels are always reported in RGB order */
+typedef struct {
+    int      components;
+    uint64_t pixelCount;
+    uint32_t histogram[STATS_MAX_CHANNELS][256];
+    uint8_t  min[STATS_MAX_CHANNELS];
+    uint8_t  max[STATS_MAX_CHANNELS];
+    double   mean[STATS_MAX_CHANNELS];
+    double   variance[STATS_MAX_CHANNELS];
+} ImageStats;
+
+/* Running state used to collect statistics one row at a time */
+typedef struct {
+    int      components;
+    int      bgr;               // rows are stored in BGR order (BMP) and must be swapped when reported
+    uint64_t pixelCount;
+    uint32_t sub[STATS_SUBHISTOGRAMS][STATS_MAX_CHANNELS][256];
+} StatsAccumulator;
+
+int stats_begin(StatsAccumulator *acc, int components, int bgr);
+void stats_accumulate_row(StatsAccumulator *acc, const uint8_t *row, int width);
+void stats_finish(StatsAccumulator *acc, ImageStats *stats);
+int compute_image_stats(const uint8_t *image_buffer, int width, int height, int components, ImageStats *stats);
+int auto_levels(uint8_t *image_buffer, int width, int height, int components, const ImageStats *stats, double clipPercent);
+
+#endif
@@ -0,0 +1,37 @@
+/* ycbcr.h */
+
+#ifndef YCBCR_H
+#define YCBCR_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+
+#define YCBCR_ROW_GROUP     16      // luma rows per 4:2:0 iMCU row (2 * DCTSIZE)
+
+/*
+ *  Planar YCbCr 4:2:0 image --- planes are padded to whole iMCUs so they can be handed to libjpeg raw data calls.
+ *  The planes hold either the whole image (ycbcr_alloc) or one iMCU row at a time (ycbcr_alloc_group).
+ */
+typedef struct {
+    int      width;
+    int      height;
+    int      lumaStride;        // width rounded up to a multiple of 16
+    int      lumaRows;          // rows held: height rounded up to a multiple of 16, or 16 for a row group
+    int      chromaStride;      // lumaStride / 2
+    int      chromaRows;        // lumaRows / 2
+    int      rowOffset;         // image row held in the first luma row (0 unless the planes hold a row group)
+    uint8_t *y;
+    uint8_t *cb;
+    uint8_t *cr;
+} YCbCrImage;
+
+int ycbcr_alloc(YCbCrImage *img, int width, int height);
+int ycbcr_alloc_group(YCbCrImage *img, int width, int height);
+void ycbcr_free(YCbCrImage *img);
+int bgr_to_ycbcr420(const uint8_t *pixelData, int bottomUp, YCbCrImage *img, int firstRow, int numRows);
+int ycbcr420_to_bgr(const YCbCrImage *img, uint8_t *pixelData, int bottomUp, int firstRow, int numRows);
+
+#endif
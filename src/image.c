@@ -3,6 +3,154 @@
 #include "image.h"
 #include "bmp.h"
 #include "jpeg.h"
+#include "resize.h"
+
+#include <pthread.h>
+
+#define PYRAMID_MAX_LEVELS  16
+
+/* One output of jpeg_pyramid, encoded on its own thread */
+typedef struct {
+    const char    *dest;
+    unsigned char *pixels;
+    int            width;
+    int            height;
+    int            components;
+    int            status;
+} PyramidLevel;
+
+/**
+ * This function compresses 24-bit BMP pixel data into a JPEG file
+ * through YCbCr 4:2:0 planes. BGR rows are converted and downsampled
+ * one iMCU row (16 rows) at a time into planes that hold only that row
+ * group, which are handed straight to libjpeg; statistics are collected
+ * from the same rows while they are still in cache.
+ *
+ *      @param dest         - This is the path to the new JPEG file
+ *      @param pixelData    - BGR pixel data, bottom to top (as returned by get_bmp_pixeldata)
+ *      @param width        - width in pixels of image
+ *      @param height       - height in pixels of image
+ *      @param stats        - statistics of the image --- returned via pointer (NULL to skip)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+static int bgr_pixels_to_jpeg(const char *dest, const uint8_t *pixelData, int width, int height, ImageStats *stats) {
+    YCbCrImage group;
+    if (ycbcr_alloc_group(&group, width, height) == -1) {
+        return -1;
+    }
+
+    StatsAccumulator *acc = NULL;
+    if (stats) {
+        acc = (StatsAccumulator *)malloc(sizeof(StatsAccumulator));
+        if (!acc || stats_begin(acc, 3, 1) == -1) {
+            fprintf(stderr, "Failed to prepare statistics.\n");
+            free(acc);
+            ycbcr_free(&group);
+            return -1;
+        }
+    }
+
+    YCbCrWriter writer;
+    if (compress_ycbcr_begin(&writer, dest, width, height) == -1) {
+        free(acc);
+        ycbcr_free(&group);
+        return -1;
+    }
+
+    for (int y = 0; y < height; y += YCBCR_ROW_GROUP) {
+        group.rowOffset = y;
+        if (bgr_to_ycbcr420(pixelData, 1, &group, y, YCBCR_ROW_GROUP) == -1 ||
+            compress_ycbcr_rows(&writer, &group) == -1) {
+            compress_ycbcr_abort(&writer);
+            free(acc);
+            ycbcr_free(&group);
+            return -1;
+        }
+
+        for (int row = y; acc && row < y + YCBCR_ROW_GROUP && row < height; row++) {
+            stats_accumulate_row(acc, pixelData + (size_t)(height - 1 - row) * width * 3, width);
+        }
+    }
+
+    if (acc) {
+        stats_finish(acc, stats);
+        free(acc);
+    }
+
+    ycbcr_free(&group);
+    return compress_ycbcr_finish(&writer);
+}
+
+/**
+ * This function converts a YCbCr 4:2:0 JPEG file to a 24-bit BMP file
+ * without going through libjpeg's upsampling and color conversion
+ * (the result matches a libjpeg decode to within 1 per channel).
+ * Planes are converted to BGR one iMCU row (16 rows) at a time, and
+ * statistics are collected from the same rows while they are still in cache.
+ *
+ *      @param source       - This is the path to a JPEG file to be converted
+ *      @param dest         - This is the path to the new BMP file
+ *      @param stats        - statistics of the image --- returned via pointer (NULL to skip)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success, 1 -> source is not 4:2:0 YCbCr (nothing written)
+ */
+static int jpeg_ycbcr_to_bmp(const char *source, const char *dest, ImageStats *stats) {
+    YCbCrImage img;
+    int status = decompress_jpeg_ycbcr(source, &img);
+    if (status != 0) {
+        return status;
+    }
+
+    int width   = img.width;
+    int height  = img.height;
+    uint8_t *pixelData = (uint8_t *)malloc((size_t)width * height * 3);
+    if (!pixelData) {
+        fprintf(stderr, "Failed to allocate memory for pixel data array\n");
+        ycbcr_free(&img);
+        return -1;
+    }
+
+    StatsAccumulator *acc = NULL;
+    if (stats) {
+        acc = (StatsAccumulator *)malloc(sizeof(StatsAccumulator));
+        if (!acc || stats_begin(acc, 3, 1) == -1) {
+            fprintf(stderr, "Failed to prepare statistics.\n");
+            free(acc);
+            free(pixelData);
+            ycbcr_free(&img);
+            return -1;
+        }
+    }
+
+    for (int y = 0; y < height; y += YCBCR_ROW_GROUP) {
+        if (ycbcr420_to_bgr(&img, pixelData, 1, y, YCBCR_ROW_GROUP) == -1) {
+            free(acc);
+            free(pixelData);
+            ycbcr_free(&img);
+            return -1;
+        }
+
+        for (int row = y; acc && row < y + YCBCR_ROW_GROUP && row < height; row++) {
+            stats_accumulate_row(acc, pixelData + (size_t)(height - 1 - row) * width * 3, width);
+        }
+    }
+    ycbcr_free(&img);
+
+    if (acc) {
+        stats_finish(acc, stats);
+        free(acc);
+    }
+
+    if (save_as_bmp(dest, pixelData, NULL, width, height, 24, 0, 96, 96, 0, 0) == -1) {
+        fprintf(stderr, "Failed to save BMP file\n");
+        free(pixelData);
+        return -1;
+    }
+
+    free(pixelData);
+    return 0;
+}
 
 /**
  * This function converts a given BMP image file to
@@ -14,6 +162,21 @@
  *      @return success of operation: -1 -> failure, 0 -> success
  */
 int bmp_to_jpeg(const char *source, const char *dest) {
+    return bmp_to_jpeg_with_stats(source, dest, NULL);
+}
+
+/**
+ * This function converts a given BMP image file to
+ * a new JPEG file, collecting per-channel statistics
+ * from each row as it is converted.
+ *
+ *      @param source       - This is the path to a BMP file to be converted
+ *      @param dest         - This is the path to the new JPEG file
+ *      @param stats        - statistics of the image --- returned via pointer (NULL to skip)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int bmp_to_jpeg_with_stats(const char *source, const char *dest, ImageStats *stats) {
     BMPHeader *bmpHeader = (BMPHeader *)malloc(sizeof(BMPHeader));
     if (!bmpHeader) {
         fprintf(stderr, "Failed to allocate memory for bmpHeader\n");
@@ -65,6 +228,18 @@ int bmp_to_jpeg(const char *source, const char *dest) {
         free(pixelData);
         return -1;
     }
+
+    /* 24-bit images go straight from BGR rows to YCbCr 4:2:0 planes */
+    if (bitsPerPixel / 8 == 3) {
+        int status = bgr_pixels_to_jpeg(dest, pixelData, width, height, stats);
+        if (status == -1) {
+            fprintf(stderr, "Failed to compress jpeg file\n");
+        }
+        free(bmpHeader);
+        free(dibHeader);
+        free(pixelData);
+        return status;
+    }
     
     unsigned char *image_buffer = malloc(height * width * (bitsPerPixel / 8));
     if (!image_buffer) {
@@ -74,6 +249,20 @@ int bmp_to_jpeg(const char *source, const char *dest) {
         free(pixelData);
         return -1;
     }
+
+    StatsAccumulator *acc = NULL;
+    if (stats) {
+        acc = (StatsAccumulator *)malloc(sizeof(StatsAccumulator));
+        if (!acc || stats_begin(acc, bitsPerPixel / 8, 0) == -1) {
+            fprintf(stderr, "Failed to prepare statistics.\n");
+            free(bmpHeader);
+            free(dibHeader);
+            free(pixelData);
+            free(image_buffer);
+            free(acc);
+            return -1;
+        }
+    }
     
     for (int y = 0; y < height; y++) {
         int bmp_y = height - 1 - y; // file row order bottom to top for BMP - read top to bottom
@@ -101,6 +290,15 @@ int bmp_to_jpeg(const char *source, const char *dest) {
                 image_buffer[index] = (unsigned char)gray;
             }
         }
+
+        if (acc) {
+            stats_accumulate_row(acc, image_buffer + y * width * (bitsPerPixel / 8), width);    // row is still in cache
+        }
+    }
+
+    if (acc) {
+        stats_finish(acc, stats);
+        free(acc);
     }
 
     
@@ -131,12 +329,33 @@ int bmp_to_jpeg(const char *source, const char *dest) {
  *      @return success of operation: -1 -> failure, 0 -> success
  */
 int jpeg_to_bmp(const char *source, const char *dest) {
+    return jpeg_to_bmp_with_stats(source, dest, NULL);
+}
+
+/**
+ * This function converts a given JPEG image file to
+ * a new BMP file, collecting per-channel statistics
+ * during decompression.
+ *
+ *      @param source       - This is the path to a JPEG file to be converted
+ *      @param dest         - This is the path to the new BMP file
+ *      @param stats        - statistics of the image --- returned via pointer (NULL to skip)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int jpeg_to_bmp_with_stats(const char *source, const char *dest, ImageStats *stats) {
+    /* 4:2:0 YCbCr files are decoded to planes and converted straight into BMP rows */
+    int status = jpeg_ycbcr_to_bmp(source, dest, stats);
+    if (status != 1) {
+        return status;
+    }
+
     unsigned char *image_buffer = NULL;
     int *width      = calloc(1, sizeof(int));
     int *height     = calloc(1, sizeof(int));
     int *components = calloc(1, sizeof(int));
 
-    if (decompress_jpeg(source, &image_buffer, width, height, components) == -1) {
+    if (decompress_jpeg_with_stats(source, &image_buffer, width, height, components, stats) == -1) {
         fprintf(stderr, "Failed to decompress JPEG image.\n");
         free(width);
         free(height);
@@ -333,4 +552,223 @@ int duplicate_jpeg_file(const char *source, const char *dest) {
     free(components);
     free(image_buffer);
     return 0;
+}
+
+/**
+ *  This function will take a JPEG file, rotate, flip or transpose it and
+ *  save the result to a new JPEG file. Unlike duplicate_jpeg_file, no
+ *  pixels are decompressed or recompressed: DCT coefficient blocks are
+ *  rearranged directly, so the image loses no quality.
+ *      @param source       - name of JPEG file to transform
+ *      @param dest         - name of JPEG file to write transformed image to
+ *      @param transform    - rotation, flip or transpose to apply
+ *      @param trim         - non-zero to drop edge blocks that cannot be transformed (see transform_jpeg)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int transform_jpeg_file(const char *source, const char *dest, JpegTransform transform, int trim) {
+    if (transform_jpeg(source, dest, transform, trim) == -1) {
+        fprintf(stderr, "Failed to transform JPEG image.\n");
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  This function will take a JPEG file, stretch the contrast of each
+ *  color channel to the full range (auto-levels) and save the result
+ *  to a new JPEG file. Statistics are gathered during decompression,
+ *  so the source pixels are only read once before adjustment.
+ *      @param source       - name of JPEG file to adjust
+ *      @param dest         - name of JPEG file to write adjusted image to
+ *      @param clipPercent  - percentage of pixels to clip at each end of every channel
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int auto_level_jpeg_file(const char *source, const char *dest, double clipPercent) {
+    unsigned char *image_buffer = NULL;
+    int width;
+    int height;
+    int components;
+    ImageStats stats;
+
+    if (decompress_jpeg_with_stats(source, &image_buffer, &width, &height, &components, &stats) == -1) {
+        fprintf(stderr, "Failed to decompress JPEG image.\n");
+        if (image_buffer) free(image_buffer);
+        return -1;
+    }
+
+    if (auto_levels(image_buffer, width, height, components, &stats, clipPercent) == -1) {
+        fprintf(stderr, "Failed to apply auto levels\n");
+        free(image_buffer);
+        return -1;
+    }
+
+    int in_color_space = (components == 3) ? JCS_RGB : JCS_GRAYSCALE;
+    if (compress_jpeg(dest, image_buffer, width, height, components, in_color_space) == -1) {
+        fprintf(stderr, "Failed to compress jpeg file\n");
+        free(image_buffer);
+        return -1;
+    }
+
+    free(image_buffer);
+    return 0;
+}
+
+/**
+ *  This function compresses one pyramid level into its JPEG file.
+ *  It is used as a thread entry point by jpeg_pyramid.
+ *      @param arg      - PyramidLevel to encode (status is set to the result of compress_jpeg)
+ */
+static void *encode_pyramid_level(void *arg) {
+    PyramidLevel *level = (PyramidLevel *)arg;
+    int in_color_space = (level->components == 3) ? JCS_RGB : JCS_GRAYSCALE;
+    level->status = compress_jpeg(level->dest, level->pixels, level->width, level->height, level->components, in_color_space);
+    return NULL;
+}
+
+/**
+ *  This function will take a JPEG file and write several reduced copies of it
+ *  (e.g. 2048, 1024, 512 and 128 pixels on the long edge) from a single decode.
+ *  The source is decoded once with DCT scaling to just above the largest size,
+ *  each smaller level is derived from the previous one by 2x box reductions
+ *  (plus one area resample when the ratio is not a power of two), and every
+ *  level starts encoding on its own thread as soon as it is ready.
+ *  Sizes larger than the source are clamped to the source dimensions.
+ *      @param source   - name of JPEG file to reduce
+ *      @param sizes    - long edge in pixels of each output, in any order
+ *      @param dests    - name of JPEG file to write for each entry of sizes
+ *      @param count    - number of outputs (at most PYRAMID_MAX_LEVELS)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int jpeg_pyramid(const char *source, const int *sizes, const char **dests, int count) {
+    if (!sizes || !dests || count < 1 || count > PYRAMID_MAX_LEVELS) {
+        fprintf(stderr, "Invalid number of pyramid levels\n");
+        return -1;
+    }
+    for (int i = 0; i < count; i++) {
+        if (sizes[i] <= 0 || !dests[i]) {
+            fprintf(stderr, "Invalid pyramid level %d\n", i);
+            return -1;
+        }
+    }
+
+    /* Work from the largest level down */
+    int order[PYRAMID_MAX_LEVELS];
+    for (int i = 0; i < count; i++) {
+        int j = i;
+        while (j > 0 && sizes[order[j - 1]] < sizes[i]) {
+            order[j] = order[j - 1];
+            j--;
+        }
+        order[j] = i;
+    }
+
+    unsigned char *decoded = NULL;
+    int width;
+    int height;
+    int components;
+    if (decompress_jpeg_scaled(source, &decoded, &width, &height, &components, sizes[order[0]]) == -1) {
+        fprintf(stderr, "Failed to decompress JPEG image.\n");
+        if (decoded) free(decoded);
+        return -1;
+    }
+
+    PyramidLevel levels[PYRAMID_MAX_LEVELS];
+    pthread_t tids[PYRAMID_MAX_LEVELS];
+    int started[PYRAMID_MAX_LEVELS] = {0};
+    int status = 0;
+
+    unsigned char *cur  = decoded;      // image the next level is derived from
+    int curWidth        = width;
+    int curHeight       = height;
+    int curOwned        = 1;            // cur is not held by any level and must be freed when replaced
+    int built           = 0;
+
+    for (int k = 0; k < count && status == 0; k++) {
+        int size = sizes[order[k]];
+        int targetWidth     = width;
+        int targetHeight    = height;
+        if (width >= height && size < width) {
+            targetWidth     = size;
+            targetHeight    = (int)(((int64_t)height * size + width / 2) / width);
+        } else if (height > width && size < height) {
+            targetHeight    = size;
+            targetWidth     = (int)(((int64_t)width * size + height / 2) / height);
+        }
+        if (targetWidth < 1)  targetWidth = 1;
+        if (targetHeight < 1) targetHeight = 1;
+
+        /* Halve while the result is still at least as large as the target */
+        while (curWidth / 2 >= targetWidth && curHeight / 2 >= targetHeight) {
+            unsigned char *half = (unsigned char *)malloc((size_t)(curWidth / 2) * (curHeight / 2) * components);
+            if (!half || downscale_2x(cur, curWidth, curHeight, components, half) == -1) {
+                fprintf(stderr, "Failed to reduce pyramid level\n");
+                free(half);
+                status = -1;
+                break;
+            }
+            if (curOwned) free(cur);
+            cur         = half;
+            curWidth    /= 2;
+            curHeight   /= 2;
+            curOwned    = 1;
+        }
+        if (status == -1) break;
+
+        /* Finish off a non power of two ratio with an area resample */
+        if (curWidth != targetWidth || curHeight != targetHeight) {
+            unsigned char *resized = (unsigned char *)malloc((size_t)targetWidth * targetHeight * components);
+            if (!resized || resize_area(cur, curWidth, curHeight, components, resized, targetWidth, targetHeight) == -1) {
+                fprintf(stderr, "Failed to resize pyramid level\n");
+                free(resized);
+                status = -1;
+                break;
+            }
+            if (curOwned) free(cur);
+            cur         = resized;
+            curWidth    = targetWidth;
+            curHeight   = targetHeight;
+        }
+        curOwned = 0;
+
+        PyramidLevel *level = &levels[order[k]];
+        level->dest         = dests[order[k]];
+        level->pixels       = cur;
+        level->width        = curWidth;
+        level->height       = curHeight;
+        level->components   = components;
+        level->status       = 0;
+        built++;
+
+        // encode while the next level is being reduced; fall back to encoding here if a thread fails to start
+        if (pthread_create(&tids[order[k]], NULL, encode_pyramid_level, level) == 0) {
+            started[order[k]] = 1;
+        } else {
+            encode_pyramid_level(level);
+        }
+    }
+
+    for (int k = 0; k < built; k++) {
+        PyramidLevel *level = &levels[order[k]];
+        if (started[order[k]]) {
+            pthread_join(tids[order[k]], NULL);
+        }
+        if (level->status == -1) {
+            fprintf(stderr, "Failed to compress jpeg file %s\n", level->dest);
+            status = -1;
+        }
+    }
+
+    /* Levels of equal size share a buffer, so only free each one once */
+    for (int k = 0; k < built; k++) {
+        unsigned char *pixels = levels[order[k]].pixels;
+        if (k == 0 || pixels != levels[order[k - 1]].pixels) {
+            free(pixels);
+        }
+    }
+    if (curOwned) free(cur);
+
+    return status;
 }
\ No newline at end of file
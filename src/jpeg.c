@@ -1,6 +1,11 @@
 /* jpeg.c */
 
 #include "jpeg.h"
+#include "simd.h"
+
+#define TRANSPOSE_BAND_ROWS     16      // destination block rows filled per pass of a transpose
+
+static int decompress_jpeg_internal(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components, int minSize, ImageStats *stats);
 
 /**
  *  This function will take a jpeg file and decompress it into pixel data.
@@ -14,6 +19,60 @@
  *      @return success of operation: -1 -> failure, 0 -> success
  */
 int decompress_jpeg(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components) {
+    return decompress_jpeg_internal(filename, image_buffer, width, height, components, 0, NULL);
+}
+
+/**
+ *  This function will take a jpeg file and decompress it into pixel data,
+ *  collecting per-channel statistics from each scanline as it is decoded.
+ *
+ *      @param filename         - name of source file of compressed data
+ *      @param image_buffer     - raw pixel data from decompression --- returned via pointer (must be allocated in function and freed by caller)
+ *      @param width            - width in pixels of decompressed image --- returned via pointer
+ *      @param height           - height in pixels of decompressed image --- returned via pointer
+ *      @param colors           - number of colors used in image --- returned via pointer
+ *      @param stats            - statistics of the decoded image --- returned via pointer (NULL to skip)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int decompress_jpeg_with_stats(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components, ImageStats *stats) {
+    return decompress_jpeg_internal(filename, image_buffer, width, height, components, 0, stats);
+}
+
+/**
+ *  This function will take a jpeg file and decompress it at a reduced size
+ *  using libjpeg's DCT scaling (1/2, 1/4 or 1/8), which skips most of the
+ *  inverse DCT work. The smallest scale whose long edge is still at least
+ *  minSize pixels is chosen; images already smaller are decoded at full size.
+ *
+ *      @param filename         - name of source file of compressed data
+ *      @param image_buffer     - raw pixel data from decompression --- returned via pointer (must be allocated in function and freed by caller)
+ *      @param width            - width in pixels of decompressed image --- returned via pointer
+ *      @param height           - height in pixels of decompressed image --- returned via pointer
+ *      @param colors           - number of colors used in image --- returned via pointer
+ *      @param minSize          - smallest acceptable long edge in pixels
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int decompress_jpeg_scaled(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components, int minSize) {
+    return decompress_jpeg_internal(filename, image_buffer, width, height, components, minSize, NULL);
+}
+
+/**
+ *  This function will take a jpeg file and decompress it into pixel data,
+ *  optionally using libjpeg's DCT scaling and collecting statistics.
+ *
+ *      @param filename         - name of source file of compressed data
+ *      @param image_buffer     - raw pixel data from decompression --- returned via pointer (must be allocated in function and freed by caller)
+ *      @param width            - width in pixels of decompressed image --- returned via pointer
+ *      @param height           - height in pixels of decompressed image --- returned via pointer
+ *      @param colors           - number of colors used in image --- returned via pointer
+ *      @param minSize          - smallest acceptable long edge in pixels when scaling (0 for full size)
+ *      @param stats            - statistics of the decoded image --- returned via pointer (NULL to skip)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+static int decompress_jpeg_internal(const char *filename, unsigned char **image_buffer, int *width, int *height, int *components, int minSize, ImageStats *stats) {
     struct jpeg_decompress_struct cinfo;
     struct jpeg_error_mgr jerr;
 
@@ -28,16 +87,44 @@ int decompress_jpeg(const char *filename, unsigned char **image_buffer, int *wid
     jpeg_stdio_src(&cinfo, infile);         // set source as file
     jpeg_read_header(&cinfo, TRUE);         // read header markers
 
+    /* Pick the largest DCT scale-down (1/8, 1/4, 1/2) that keeps the long edge at least minSize */
+    if (minSize > 0) {
+        for (int denom = 8; denom > 1; denom /= 2) {
+            cinfo.scale_num     = 1;
+            cinfo.scale_denom   = denom;
+            jpeg_calc_output_dimensions(&cinfo);
+            int longEdge = (cinfo.output_width > cinfo.output_height) ? cinfo.output_width : cinfo.output_height;
+            if (longEdge >= minSize) {
+                break;
+            }
+            cinfo.scale_denom = 1;
+        }
+    }
+
     jpeg_start_decompress(&cinfo);
 
     *width      = cinfo.output_width;
     *height     = cinfo.output_height;
     *components = cinfo.out_color_components;   // 3 for RGB, 1 for Greyscale
 
+    StatsAccumulator *acc = NULL;
+    if (stats) {
+        acc = (StatsAccumulator *)malloc(sizeof(StatsAccumulator));
+        if (!acc || stats_begin(acc, *components, 0) == -1) {
+            fprintf(stderr, "Failed to prepare statistics for decompression.\n");
+            free(acc);
+            jpeg_destroy_decompress(&cinfo);
+            fclose(infile);
+            return -1;
+        }
+    }
+
     /* Allocate memory to image_buffer */
     *image_buffer = calloc(1, (*width) * (*height) * (*components));
     if (!*image_buffer) {
         fprintf(stderr, "Failed to allocate memory for image buffer.\n");
+        free(acc);
+        jpeg_destroy_decompress(&cinfo);
         fclose(infile);
         return -1;
     }
@@ -46,6 +133,15 @@ int decompress_jpeg(const char *filename, unsigned char **image_buffer, int *wid
     while(cinfo.output_scanline < cinfo.output_height) {
         row_pointer[0] = &(*image_buffer)[cinfo.output_scanline * (*width) * (*components)];
         jpeg_read_scanlines(&cinfo, row_pointer, 1);
+
+        if (acc) {
+            stats_accumulate_row(acc, row_pointer[0], *width);     // row is still in cache
+        }
+    }
+
+    if (acc) {
+        stats_finish(acc, stats);
+        free(acc);
     }
 
     jpeg_finish_decompress(&cinfo);
@@ -106,3 +202,599 @@ int compress_jpeg(const char *filename, unsigned char *image_buffer, int width,
 
     return 0;
 }
+
+/**
+ *  This function will take planar YCbCr 4:2:0 data and compress it into a
+ *  jpeg file using libjpeg's raw data interface, bypassing its own color
+ *  conversion and chroma downsampling.
+ *
+ *      @param filename         - name of destination file of compressed data
+ *      @param img              - YCbCr planes of the whole image to be compressed (see ycbcr_alloc)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compress_jpeg_ycbcr(const char *filename, const YCbCrImage *img) {
+    YCbCrWriter writer;
+    if (compress_ycbcr_begin(&writer, filename, img->width, img->height) == -1) {
+        return -1;
+    }
+
+    while (writer.cinfo.next_scanline < writer.cinfo.image_height) {
+        if (compress_ycbcr_rows(&writer, img) == -1) {
+            compress_ycbcr_abort(&writer);
+            return -1;
+        }
+    }
+
+    return compress_ycbcr_finish(&writer);
+}
+
+/**
+ *  This function starts writing a jpeg file from planar YCbCr 4:2:0 data,
+ *  which is then handed over one iMCU row (16 luma rows) at a time with
+ *  compress_ycbcr_rows, so the whole image never needs to be held as planes.
+ *
+ *      @param writer           - YCbCrWriter to initialize
+ *      @param filename         - name of destination file of compressed data
+ *      @param width            - width in pixels of image
+ *      @param height           - height in pixels of image
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compress_ycbcr_begin(YCbCrWriter *writer, const char *filename, int width, int height) {
+    writer->outfile = fopen(filename, "wb");
+    if (!writer->outfile) {
+        fprintf(stderr, "Failed to open JPEG file for writing.\n");
+        return -1;
+    }
+
+    writer->cinfo.err = jpeg_std_error(&writer->jerr);
+    jpeg_create_compress(&writer->cinfo);
+    jpeg_stdio_dest(&writer->cinfo, writer->outfile);
+
+    // set cinfo parameters --- data is already YCbCr and downsampled
+    writer->cinfo.image_width       = width;
+    writer->cinfo.image_height      = height;
+    writer->cinfo.input_components  = 3;
+    writer->cinfo.in_color_space    = JCS_YCbCr;
+    jpeg_set_defaults(&writer->cinfo);
+    writer->cinfo.raw_data_in = TRUE;
+    writer->cinfo.comp_info[0].h_samp_factor = 2;
+    writer->cinfo.comp_info[0].v_samp_factor = 2;
+    for (int ci = 1; ci < 3; ci++) {
+        writer->cinfo.comp_info[ci].h_samp_factor = 1;
+        writer->cinfo.comp_info[ci].v_samp_factor = 1;
+    }
+
+    jpeg_start_compress(&writer->cinfo, TRUE);
+    return 0;
+}
+
+/**
+ *  This function compresses the next iMCU row (16 luma rows, 8 chroma rows)
+ *  of a jpeg file started with compress_ycbcr_begin.
+ *
+ *      @param writer           - YCbCrWriter being written
+ *      @param img              - YCbCr planes holding the next iMCU row (a row group or the whole image)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compress_ycbcr_rows(YCbCrWriter *writer, const YCbCrImage *img) {
+    int planeRow = (int)writer->cinfo.next_scanline - img->rowOffset;
+    if (planeRow < 0 || planeRow + YCBCR_ROW_GROUP > img->lumaRows) {
+        fprintf(stderr, "Next JPEG rows are not held in the YCbCr planes.\n");
+        return -1;
+    }
+
+    JSAMPROW yRows[YCBCR_ROW_GROUP];
+    JSAMPROW cbRows[YCBCR_ROW_GROUP / 2];
+    JSAMPROW crRows[YCBCR_ROW_GROUP / 2];
+    JSAMPARRAY planes[3] = {yRows, cbRows, crRows};
+    for (int i = 0; i < YCBCR_ROW_GROUP; i++) {
+        yRows[i] = img->y + (size_t)(planeRow + i) * img->lumaStride;
+    }
+    for (int i = 0; i < YCBCR_ROW_GROUP / 2; i++) {
+        cbRows[i] = img->cb + (size_t)(planeRow / 2 + i) * img->chromaStride;
+        crRows[i] = img->cr + (size_t)(planeRow / 2 + i) * img->chromaStride;
+    }
+    jpeg_write_raw_data(&writer->cinfo, planes, YCBCR_ROW_GROUP);
+    return 0;
+}
+
+/**
+ *  This function completes a jpeg file once every iMCU row has been written.
+ *
+ *      @param writer           - YCbCrWriter to complete
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compress_ycbcr_finish(YCbCrWriter *writer) {
+    jpeg_finish_compress(&writer->cinfo);
+    jpeg_destroy_compress(&writer->cinfo);
+
+    fclose(writer->outfile);
+
+    return 0;
+}
+
+/**
+ *  This function abandons a jpeg file started with compress_ycbcr_begin.
+ *
+ *      @param writer           - YCbCrWriter to release
+ */
+void compress_ycbcr_abort(YCbCrWriter *writer) {
+    jpeg_destroy_compress(&writer->cinfo);
+    fclose(writer->outfile);
+}
+
+/**
+ *  This function will take a jpeg file and decompress it into planar
+ *  YCbCr 4:2:0 data using libjpeg's raw data interface, bypassing its own
+ *  chroma upsampling and color conversion. Only files stored as YCbCr with
+ *  2x2 luma sampling can be decoded this way.
+ *
+ *      @param filename         - name of source file of compressed data
+ *      @param img              - YCbCr planes of decompressed image --- returned via pointer (free with ycbcr_free)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success, 1 -> file is not 4:2:0 YCbCr (nothing decoded)
+ */
+int decompress_jpeg_ycbcr(const char *filename, YCbCrImage *img) {
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+
+    FILE *infile = fopen(filename, "rb");
+    if (!infile) {
+        fprintf(stderr, "Failed to open JPEG file for reading.\n");
+        return -1;
+    }
+
+    cinfo.err = jpeg_std_error(&jerr);
+    jpeg_create_decompress(&cinfo);
+    jpeg_stdio_src(&cinfo, infile);
+    jpeg_read_header(&cinfo, TRUE);
+
+    /* Check the file's layout matches the planes we can hold */
+    if (cinfo.num_components != 3 || cinfo.jpeg_color_space != JCS_YCbCr ||
+        cinfo.comp_info[0].h_samp_factor != 2 || cinfo.comp_info[0].v_samp_factor != 2 ||
+        cinfo.comp_info[1].h_samp_factor != 1 || cinfo.comp_info[1].v_samp_factor != 1 ||
+        cinfo.comp_info[2].h_samp_factor != 1 || cinfo.comp_info[2].v_samp_factor != 1) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(infile);
+        return 1;
+    }
+
+    cinfo.raw_data_out  = TRUE;
+    cinfo.out_color_space = JCS_YCbCr;
+    jpeg_start_decompress(&cinfo);
+
+    if (ycbcr_alloc(img, cinfo.output_width, cinfo.output_height) == -1) {
+        jpeg_destroy_decompress(&cinfo);
+        fclose(infile);
+        return -1;
+    }
+
+    JSAMPROW yRows[YCBCR_ROW_GROUP];
+    JSAMPROW cbRows[YCBCR_ROW_GROUP / 2];
+    JSAMPROW crRows[YCBCR_ROW_GROUP / 2];
+    JSAMPARRAY planes[3] = {yRows, cbRows, crRows};
+    while (cinfo.output_scanline < cinfo.output_height) {
+        int row = cinfo.output_scanline;
+        for (int i = 0; i < YCBCR_ROW_GROUP; i++) {
+            yRows[i] = img->y + (size_t)(row + i) * img->lumaStride;
+        }
+        for (int i = 0; i < YCBCR_ROW_GROUP / 2; i++) {
+            cbRows[i] = img->cb + (size_t)(row / 2 + i) * img->chromaStride;
+            crRows[i] = img->cr + (size_t)(row / 2 + i) * img->chromaStride;
+        }
+        jpeg_read_raw_data(&cinfo, planes, YCBCR_ROW_GROUP);
+    }
+
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+
+    fclose(infile);
+
+    return 0;
+}
+
+/* How the coefficients of one block are rearranged: dst[k] = src[index[k]] * sign[k] */
+typedef struct {
+    int transpose;
+    int negateOddCols;          // in the destination block
+    int negateOddRows;
+    int index[DCTSIZE2];
+    int sign[DCTSIZE2];
+} CoefMapping;
+
+/**
+ *  This function describes a transform as a transpose (optional) followed
+ *  by mirroring the source columns and/or rows.
+ *      @param transform    - transform to describe
+ *      @param transpose    - non-zero if source rows become destination columns --- returned via pointer
+ *      @param mirrorX      - non-zero if source columns are mirrored --- returned via pointer
+ *      @param mirrorY      - non-zero if source rows are mirrored --- returned via pointer
+ *
+ *      @return success of operation: -1 -> failure (unknown transform), 0 -> success
+ */
+static int transform_flags(JpegTransform transform, int *transpose, int *mirrorX, int *mirrorY) {
+    switch (transform) {
+        case JPEG_TRANSFORM_NONE:       *transpose = 0; *mirrorX = 0; *mirrorY = 0; break;
+        case JPEG_TRANSFORM_FLIP_H:     *transpose = 0; *mirrorX = 1; *mirrorY = 0; break;
+        case JPEG_TRANSFORM_FLIP_V:     *transpose = 0; *mirrorX = 0; *mirrorY = 1; break;
+        case JPEG_TRANSFORM_ROT_180:    *transpose = 0; *mirrorX = 1; *mirrorY = 1; break;
+        case JPEG_TRANSFORM_TRANSPOSE:  *transpose = 1; *mirrorX = 0; *mirrorY = 0; break;
+        case JPEG_TRANSFORM_ROT_90:     *transpose = 1; *mirrorX = 0; *mirrorY = 1; break;
+        case JPEG_TRANSFORM_ROT_270:    *transpose = 1; *mirrorX = 1; *mirrorY = 0; break;
+        case JPEG_TRANSFORM_TRANSVERSE: *transpose = 1; *mirrorX = 1; *mirrorY = 1; break;
+        default:
+            return -1;
+    }
+    return 0;
+}
+
+/**
+ *  This function builds the coefficient mapping of one block. Mirroring a
+ *  block negates its odd frequencies along that axis; transposing it
+ *  transposes the coefficients.
+ *      @param map          - CoefMapping to populate
+ *      @param transpose    - non-zero to transpose the block
+ *      @param mirrorX      - non-zero to mirror the block's columns
+ *      @param mirrorY      - non-zero to mirror the block's rows
+ */
+static void coef_mapping(CoefMapping *map, int transpose, int mirrorX, int mirrorY) {
+    for (int v = 0; v < DCTSIZE; v++) {
+        for (int u = 0; u < DCTSIZE; u++) {
+            int su = transpose ? v : u;     // frequencies in the source block
+            int sv = transpose ? u : v;
+            int negate = ((mirrorX && (su & 1)) != 0) ^ ((mirrorY && (sv & 1)) != 0);
+            map->index[v * DCTSIZE + u] = sv * DCTSIZE + su;
+            map->sign[v * DCTSIZE + u]  = negate ? -1 : 1;
+        }
+    }
+
+    map->transpose      = transpose;
+    map->negateOddCols  = transpose ? mirrorY : mirrorX;
+    map->negateOddRows  = transpose ? mirrorX : mirrorY;
+}
+
+/**
+ *  This function applies a coefficient mapping to one block.
+ *      @param in       - source block
+ *      @param out      - destination block
+ *      @param map      - mapping built by coef_mapping
+ */
+static void transform_block(const JCOEF *in, JCOEF *out, const CoefMapping *map) {
+#ifdef __SSE2__
+    __m128i r[DCTSIZE];
+    for (int i = 0; i < DCTSIZE; i++) {
+        r[i] = _mm_loadu_si128((const __m128i *)(in + i * DCTSIZE));
+    }
+
+    if (map->transpose) {
+        __m128i a[DCTSIZE], b[DCTSIZE];
+        for (int i = 0; i < DCTSIZE; i += 2) {
+            a[i]     = _mm_unpacklo_epi16(r[i], r[i + 1]);
+            a[i + 1] = _mm_unpackhi_epi16(r[i], r[i + 1]);
+        }
+        for (int i = 0; i < DCTSIZE; i += 4) {
+            b[i]     = _mm_unpacklo_epi32(a[i], a[i + 2]);
+            b[i + 1] = _mm_unpackhi_epi32(a[i], a[i + 2]);
+            b[i + 2] = _mm_unpacklo_epi32(a[i + 1], a[i + 3]);
+            b[i + 3] = _mm_unpackhi_epi32(a[i + 1], a[i + 3]);
+        }
+        for (int i = 0; i < 4; i++) {
+            r[2 * i]     = _mm_unpacklo_epi64(b[i], b[i + 4]);
+            r[2 * i + 1] = _mm_unpackhi_epi64(b[i], b[i + 4]);
+        }
+    }
+
+    /* Negate with (x ^ mask) - mask, mask being all ones where the sign flips */
+    __m128i colMask = map->negateOddCols ? _mm_set_epi16(-1, 0, -1, 0, -1, 0, -1, 0) : _mm_setzero_si128();
+    __m128i oddMask = map->negateOddRows ? _mm_xor_si128(colMask, _mm_set1_epi16(-1)) : colMask;
+    for (int i = 0; i < DCTSIZE; i++) {
+        __m128i mask = (i & 1) ? oddMask : colMask;
+        _mm_storeu_si128((__m128i *)(out + i * DCTSIZE), _mm_sub_epi16(_mm_xor_si128(r[i], mask), mask));
+    }
+#else
+    for (int k = 0; k < DCTSIZE2; k++) {
+        out[k] = (JCOEF)(in[map->index[k]] * map->sign[k]);
+    }
+#endif
+}
+
+/**
+ *  This function returns how many destination block rows a transpose fills
+ *  per pass: TRANSPOSE_BAND_ROWS rounded down to whole iMCU rows.
+ *      @param samp     - vertical sampling factor of the component in the destination
+ *
+ *      @return rows per band
+ */
+static int transpose_band_rows(int samp) {
+    int rows = TRANSPOSE_BAND_ROWS / samp * samp;
+    return (rows > 0) ? rows : samp;
+}
+
+/* Block layout of one component, in blocks, during transform_jpeg */
+typedef struct {
+    int h;              // source sampling factors
+    int v;
+    int srcCols;        // size of the source coefficient array
+    int srcRows;
+    int flipCols;       // source blocks inside whole iMCUs (the only ones that can be mirrored)
+    int flipRows;
+    int dstCols;        // size of the transformed component
+    int dstRows;
+} BlockGeometry;
+
+/**
+ *  This function mirrors and/or flips the blocks of one row (no transpose).
+ *      @param in       - source row
+ *      @param out      - destination row (must not overlap in)
+ *      @param geom     - block layout of the component
+ *      @param mirrorX  - non-zero to mirror the row
+ *      @param inside   - mapping of blocks that are mirrored
+ *      @param outside  - mapping of partial edge blocks that stay in place
+ */
+static void transform_row(JBLOCKROW in, JBLOCKROW out, const BlockGeometry *geom, int mirrorX, const CoefMapping *inside, const CoefMapping *outside) {
+    int cols = (geom->dstCols < geom->srcCols) ? geom->dstCols : geom->srcCols;
+    int dx = 0;
+    if (mirrorX) {
+        for (; dx < geom->flipCols && dx < cols; dx++) {
+            transform_block(in[geom->flipCols - 1 - dx], out[dx], inside);
+        }
+    }
+    for (; dx < cols; dx++) {
+        transform_block(in[dx], out[dx], outside);
+    }
+}
+
+/**
+ *  This function flips one component in place. Each strip of v block rows
+ *  is swapped with its mirror image strip through a small buffer, so only
+ *  one strip of the array is accessed at a time.
+ *      @param cinfo    - decompressor owning the array
+ *      @param array    - coefficient array of the component
+ *      @param geom     - block layout of the component
+ *      @param mirrorX  - non-zero to mirror left-right
+ *      @param mirrorY  - non-zero to mirror top-bottom
+ *      @param maps     - block mappings indexed by [mirrored in x][mirrored in y]
+ *      @param temp     - buffer of 2 * v rows of at least geom->srcCols blocks
+ */
+static void mirror_component(j_decompress_ptr cinfo, jvirt_barray_ptr array, const BlockGeometry *geom, int mirrorX, int mirrorY, CoefMapping maps[2][2], JBLOCKARRAY temp) {
+    int v = geom->v;
+    int rows = (geom->dstRows < geom->srcRows) ? geom->dstRows : geom->srcRows;
+    size_t rowBytes = (size_t)geom->srcCols * sizeof(JBLOCK);
+
+    for (int y = 0; y < rows; y += v) {
+        int partner = (mirrorY && y < geom->flipRows) ? geom->flipRows - v - y : y;
+        if (partner < y) {
+            continue;       // already swapped with its partner
+        }
+
+        JBLOCKARRAY strip = (*cinfo->mem->access_virt_barray)((j_common_ptr)cinfo, array, (JDIMENSION)y, (JDIMENSION)v, FALSE);
+        for (int i = 0; i < v; i++) {
+            memcpy(temp[i], strip[i], rowBytes);
+        }
+        if (partner != y) {
+            strip = (*cinfo->mem->access_virt_barray)((j_common_ptr)cinfo, array, (JDIMENSION)partner, (JDIMENSION)v, FALSE);
+            for (int i = 0; i < v; i++) {
+                memcpy(temp[v + i], strip[i], rowBytes);
+            }
+        }
+
+        int targets[2] = {y, partner};
+        for (int t = 0; t < ((partner != y) ? 2 : 1); t++) {
+            JBLOCKARRAY out = (*cinfo->mem->access_virt_barray)((j_common_ptr)cinfo, array, (JDIMENSION)targets[t], (JDIMENSION)v, TRUE);
+            for (int i = 0; i < v; i++) {
+                int dy = targets[t] + i;
+                int my = mirrorY && dy < geom->flipRows;
+                int sy = my ? geom->flipRows - 1 - dy : dy;
+                JBLOCKROW in = (sy >= y && sy < y + v) ? temp[sy - y] : temp[v + sy - partner];
+                transform_row(in, out[i], geom, mirrorX, &maps[1][my], &maps[0][my]);
+            }
+        }
+    }
+}
+
+/**
+ *  This function transposes (and optionally mirrors) one component into a
+ *  new array. Destination rows are filled a band at a time, column by
+ *  column, so that each source row is read as one contiguous run of blocks.
+ *      @param cinfo    - decompressor owning both arrays
+ *      @param src      - coefficient array of the component
+ *      @param dst      - destination array (geom->dstCols x geom->dstRows blocks)
+ *      @param geom     - block layout of the component
+ *      @param mirrorX  - non-zero to mirror source columns
+ *      @param mirrorY  - non-zero to mirror source rows
+ *      @param maps     - block mappings indexed by [mirrored in x][mirrored in y]
+ */
+static void transpose_component(j_decompress_ptr cinfo, jvirt_barray_ptr src, jvirt_barray_ptr dst, const BlockGeometry *geom, int mirrorX, int mirrorY, CoefMapping maps[2][2]) {
+    int bandRows = transpose_band_rows(geom->h);
+    JBLOCKARRAY srcStrip = NULL;
+    int stripRow = -1;      // first source row held in srcStrip
+
+    for (int dy = 0; dy < geom->dstRows; dy += bandRows) {
+        int rows = (geom->dstRows - dy < bandRows) ? geom->dstRows - dy : bandRows;
+        JBLOCKARRAY band = (*cinfo->mem->access_virt_barray)((j_common_ptr)cinfo, dst, (JDIMENSION)dy, (JDIMENSION)rows, TRUE);
+        stripRow = -1;      // the source is walked from the top again for every band
+
+        for (int dx = 0; dx < geom->dstCols; dx++) {
+            int my = mirrorY && dx < geom->flipRows;
+            int sy = my ? geom->flipRows - 1 - dx : dx;
+            if (sy >= geom->srcRows) {
+                for (int r = 0; r < rows; r++) {
+                    memset(band[r][dx], 0, sizeof(JBLOCK));
+                }
+                continue;
+            }
+            if (sy - sy % geom->v != stripRow) {
+                stripRow = sy - sy % geom->v;
+                srcStrip = (*cinfo->mem->access_virt_barray)((j_common_ptr)cinfo, src, (JDIMENSION)stripRow, (JDIMENSION)geom->v, FALSE);
+            }
+
+            JBLOCKROW in = srcStrip[sy - stripRow];
+            for (int r = 0; r < rows; r++) {
+                int mx = mirrorX && dy + r < geom->flipCols;
+                int sx = mx ? geom->flipCols - 1 - (dy + r) : dy + r;
+                if (sx >= geom->srcCols) {
+                    memset(band[r][dx], 0, sizeof(JBLOCK));
+                } else {
+                    transform_block(in[sx], band[r][dx], &maps[mx][my]);
+                }
+            }
+        }
+    }
+}
+
+/**
+ *  This function will take a jpeg file and rotate, flip or transpose it
+ *  losslessly by rearranging its DCT coefficient blocks (as jpegtran does),
+ *  without decoding or re-encoding any pixels.
+ *
+ *  Only whole iMCUs can be mirrored. When a mirrored dimension is not a
+ *  multiple of the iMCU size, the partial blocks at that edge either stay
+ *  where they are (trim = 0) or are dropped from the output (trim != 0).
+ *
+ *      @param source           - name of source jpeg file
+ *      @param dest             - name of destination jpeg file (may be the same as source)
+ *      @param transform        - transform to apply
+ *      @param trim             - non-zero to drop partial edge iMCUs that cannot be mirrored
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int transform_jpeg(const char *source, const char *dest, JpegTransform transform, int trim) {
+    struct jpeg_decompress_struct srcinfo;
+    struct jpeg_compress_struct dstinfo;
+    struct jpeg_error_mgr srcerr;
+    struct jpeg_error_mgr dsterr;
+    int transpose, mirrorX, mirrorY;
+
+    if (transform_flags(transform, &transpose, &mirrorX, &mirrorY) == -1) {
+        fprintf(stderr, "Unknown JPEG transform.\n");
+        return -1;
+    }
+
+    FILE *infile = fopen(source, "rb");
+    if (!infile) {
+        fprintf(stderr, "Failed to open JPEG file for reading.\n");
+        return -1;
+    }
+
+    srcinfo.err = jpeg_std_error(&srcerr);
+    jpeg_create_decompress(&srcinfo);
+    jpeg_stdio_src(&srcinfo, infile);
+    jpeg_read_header(&srcinfo, TRUE);
+
+    int iMcuWidth   = srcinfo.max_h_samp_factor * DCTSIZE;
+    int iMcuHeight  = srcinfo.max_v_samp_factor * DCTSIZE;
+    int srcWidth    = srcinfo.image_width;
+    int srcHeight   = srcinfo.image_height;
+    if (trim && mirrorX && srcWidth >= iMcuWidth) {
+        srcWidth -= srcWidth % iMcuWidth;
+    }
+    if (trim && mirrorY && srcHeight >= iMcuHeight) {
+        srcHeight -= srcHeight % iMcuHeight;
+    }
+    int mcusWide    = (srcWidth + iMcuWidth - 1) / iMcuWidth;
+    int mcusHigh    = (srcHeight + iMcuHeight - 1) / iMcuHeight;
+
+    /* Destination arrays (transposes only) must be requested before jpeg_read_coefficients realizes the source's */
+    jvirt_barray_ptr dstArrays[MAX_COMPONENTS];
+    for (int ci = 0; transpose && ci < srcinfo.num_components; ci++) {
+        jpeg_component_info *comp = &srcinfo.comp_info[ci];
+        dstArrays[ci] = (*srcinfo.mem->request_virt_barray)((j_common_ptr)&srcinfo, JPOOL_IMAGE, FALSE,
+                                                            (JDIMENSION)(mcusHigh * comp->v_samp_factor),
+                                                            (JDIMENSION)(mcusWide * comp->h_samp_factor),
+                                                            (JDIMENSION)transpose_band_rows(comp->h_samp_factor));
+    }
+
+    jvirt_barray_ptr *srcArrays = jpeg_read_coefficients(&srcinfo);
+
+    /* Blocks inside whole iMCUs are mirrored, the rest are only transposed */
+    CoefMapping maps[2][2];
+    for (int mx = 0; mx < 2; mx++) {
+        for (int my = 0; my < 2; my++) {
+            coef_mapping(&maps[mx][my], transpose, mx && mirrorX, my && mirrorY);
+        }
+    }
+
+    /* Flips are done in place through a two-strip buffer; transposes need the destination arrays */
+    int maxCols = 0;
+    for (int ci = 0; ci < srcinfo.num_components; ci++) {
+        int h = srcinfo.comp_info[ci].h_samp_factor;
+        int cols = (srcinfo.comp_info[ci].width_in_blocks + h - 1) / h * h;
+        if (cols > maxCols) maxCols = cols;
+    }
+    JBLOCKARRAY temp = transpose ? NULL : (*srcinfo.mem->alloc_barray)((j_common_ptr)&srcinfo, JPOOL_IMAGE, (JDIMENSION)maxCols, (JDIMENSION)(2 * srcinfo.max_v_samp_factor));
+
+    for (int ci = 0; ci < srcinfo.num_components; ci++) {
+        jpeg_component_info *comp = &srcinfo.comp_info[ci];
+        BlockGeometry geom;
+        geom.h          = comp->h_samp_factor;
+        geom.v          = comp->v_samp_factor;
+        geom.srcCols    = (comp->width_in_blocks + geom.h - 1) / geom.h * geom.h;
+        geom.srcRows    = (comp->height_in_blocks + geom.v - 1) / geom.v * geom.v;
+        geom.flipCols   = (srcWidth / iMcuWidth) * geom.h;
+        geom.flipRows   = (srcHeight / iMcuHeight) * geom.v;
+        geom.dstCols    = transpose ? mcusHigh * geom.v : mcusWide * geom.h;
+        geom.dstRows    = transpose ? mcusWide * geom.h : mcusHigh * geom.v;
+
+        if (transpose) {
+            transpose_component(&srcinfo, srcArrays[ci], dstArrays[ci], &geom, mirrorX, mirrorY, maps);
+        } else {
+            if (mirrorX || mirrorY) {
+                mirror_component(&srcinfo, srcArrays[ci], &geom, mirrorX, mirrorY, maps, temp);
+            }
+            dstArrays[ci] = srcArrays[ci];
+        }
+    }
+
+    /* The source has been read in full, so dest may safely overwrite it */
+    FILE *outfile = fopen(dest, "wb");
+    if (!outfile) {
+        fprintf(stderr, "Failed to open JPEG file for writing.\n");
+        jpeg_destroy_decompress(&srcinfo);
+        fclose(infile);
+        return -1;
+    }
+
+    dstinfo.err = jpeg_std_error(&dsterr);
+    jpeg_create_compress(&dstinfo);
+    jpeg_stdio_dest(&dstinfo, outfile);
+    jpeg_copy_critical_parameters(&srcinfo, &dstinfo);
+
+    dstinfo.image_width     = transpose ? srcHeight : srcWidth;
+    dstinfo.image_height    = transpose ? srcWidth : srcHeight;
+    if (transpose) {
+        for (int ci = 0; ci < dstinfo.num_components; ci++) {
+            jpeg_component_info *comp = &dstinfo.comp_info[ci];
+            int h = comp->h_samp_factor;
+            comp->h_samp_factor = comp->v_samp_factor;
+            comp->v_samp_factor = h;
+        }
+        /* Coefficients were transposed, so their quantization steps must be too */
+        for (int t = 0; t < NUM_QUANT_TBLS; t++) {
+            JQUANT_TBL *qtbl = dstinfo.quant_tbl_ptrs[t];
+            if (!qtbl) continue;
+            for (int i = 0; i < DCTSIZE; i++) {
+                for (int j = 0; j < i; j++) {
+                    UINT16 q = qtbl->quantval[i * DCTSIZE + j];
+                    qtbl->quantval[i * DCTSIZE + j] = qtbl->quantval[j * DCTSIZE + i];
+                    qtbl->quantval[j * DCTSIZE + i] = q;
+                }
+            }
+        }
+    }
+
+    jpeg_write_coefficients(&dstinfo, dstArrays);
+
+    jpeg_finish_compress(&dstinfo);
+    jpeg_destroy_compress(&dstinfo);        // destination arrays live in srcinfo's pool, so release dstinfo first
+    jpeg_finish_decompress(&srcinfo);
+    jpeg_destroy_decompress(&srcinfo);
+
+    fclose(outfile);
+    fclose(infile);
+
+    return 0;
+}
@@ -0,0 +1,664 @@
+/* metrics.c */
+
+#include "metrics.h"
+#include "bmp.h"
+#include "resize.h"
+#include "simd.h"
+
+#include <math.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <jpeglib.h>
+
+#define METRICS_MAX_THREADS     16
+#define METRICS_BAND_ALIGN      64      // 4-row blocks stay aligned at every scale (4 << (METRICS_MAX_SCALES - 1))
+#define METRICS_ROWS_PER_THREAD 256
+#define METRICS_CHUNK_ROWS      16      // rows read from each file per step when comparing files
+
+#define SSIM_C1     (0.01 * 255 * 0.01 * 255)
+#define SSIM_C2     (0.03 * 255 * 0.03 * 255)
+
+/* Weights of each MS-SSIM scale (Wang et al. 2003) */
+static const double msSsimWeights[METRICS_MAX_SCALES] = {0.0448, 0.2856, 0.3001, 0.2363, 0.1333};
+
+/**
+ *  This function adds up the squared difference of two rows of samples.
+ *      @param a, b     - samples to compare
+ *      @param n        - number of samples
+ *
+ *      @return sum of squared differences
+ */
+static uint64_t squared_error(const uint8_t *a, const uint8_t *b, size_t n) {
+    uint64_t total = 0;
+    size_t i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    while (i + 16 <= n) {
+        /* Each 32-bit lane takes at most 2 * 255^2 per step, so flush well before it can overflow */
+        __m128i acc = zero;
+        size_t stop = (n - i < 16 * 4096) ? n : i + 16 * 4096;
+        for (; i + 16 <= stop; i += 16) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(a + i));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(b + i));
+            __m128i dlo = _mm_sub_epi16(_mm_unpacklo_epi8(va, zero), _mm_unpacklo_epi8(vb, zero));
+            __m128i dhi = _mm_sub_epi16(_mm_unpackhi_epi8(va, zero), _mm_unpackhi_epi8(vb, zero));
+            acc = _mm_add_epi32(acc, _mm_add_epi32(_mm_madd_epi16(dlo, dlo), _mm_madd_epi16(dhi, dhi)));
+        }
+        uint32_t lanes[4];
+        _mm_storeu_si128((__m128i *)lanes, acc);
+        total += (uint64_t)lanes[0] + lanes[1] + lanes[2] + lanes[3];
+    }
+#endif
+    for (; i < n; i++) {
+        int d = a[i] - b[i];
+        total += d * d;
+    }
+    return total;
+}
+
+/**
+ *  This function converts a row of RGB pixels to luma.
+ *      @param rgb      - RGB pixel data for the row
+ *      @param luma     - luma output
+ *      @param width    - width in pixels of the row
+ */
+static void rgb_to_luma(const uint8_t *rgb, uint8_t *luma, int width) {
+    int x = 0;
+#ifdef __SSE2__
+    for (; x + 16 <= width; x += 16) {
+        __m128i even[3], odd[3];
+        deinterleave16(rgb + 3 * x, even, odd);
+        __m128i y = _mm_or_si128(luma8(even[0], even[1], even[2]), _mm_slli_epi16(luma8(odd[0], odd[1], odd[2]), 8));
+        _mm_storeu_si128((__m128i *)(luma + x), y);
+    }
+#endif
+    for (; x < width; x++) {
+        const uint8_t *p = rgb + 3 * x;
+        luma[x] = (uint8_t)((FIX_Y_R * p[0] + FIX_Y_G * p[1] + FIX_Y_B * p[2] + ROUND_14) >> 14);
+    }
+}
+
+/**
+ *  This function computes, for every 4x4 block of 4 buffered rows,
+ *  the sums a, b, a*a, b*b and a*b that the SSIM windows are built from.
+ *      @param sc       - scale holding 4 rows of luma for each image
+ *      @param out      - 5 arrays of sc->blocksWide sums, one after the other
+ */
+static void block_sums(const CompareScale *sc, int32_t *out) {
+    int w   = sc->width;
+    int bw  = sc->blocksWide;
+    int bx  = 0;
+#ifdef __SSE2__
+    const __m128i zero  = _mm_setzero_si128();
+    const __m128i one   = _mm_set1_epi16(1);
+    for (; bx + 4 <= bw; bx += 4) {
+        __m128i acc[5][2];
+        for (int k = 0; k < 5; k++) {
+            acc[k][0] = zero;
+            acc[k][1] = zero;
+        }
+
+        for (int r = 0; r < 4; r++) {
+            __m128i va = _mm_loadu_si128((const __m128i *)(sc->lumaA + r * w + 4 * bx));
+            __m128i vb = _mm_loadu_si128((const __m128i *)(sc->lumaB + r * w + 4 * bx));
+            __m128i a16[2] = {_mm_unpacklo_epi8(va, zero), _mm_unpackhi_epi8(va, zero)};
+            __m128i b16[2] = {_mm_unpacklo_epi8(vb, zero), _mm_unpackhi_epi8(vb, zero)};
+            for (int h = 0; h < 2; h++) {
+                acc[0][h] = _mm_add_epi32(acc[0][h], _mm_madd_epi16(a16[h], one));
+                acc[1][h] = _mm_add_epi32(acc[1][h], _mm_madd_epi16(b16[h], one));
+                acc[2][h] = _mm_add_epi32(acc[2][h], _mm_madd_epi16(a16[h], a16[h]));
+                acc[3][h] = _mm_add_epi32(acc[3][h], _mm_madd_epi16(b16[h], b16[h]));
+                acc[4][h] = _mm_add_epi32(acc[4][h], _mm_madd_epi16(a16[h], b16[h]));
+            }
+        }
+
+        /* Each lane holds a column pair; add neighbouring lanes to finish the 4-column blocks */
+        for (int k = 0; k < 5; k++) {
+            __m128i lo = _mm_add_epi32(acc[k][0], _mm_srli_epi64(acc[k][0], 32));
+            __m128i hi = _mm_add_epi32(acc[k][1], _mm_srli_epi64(acc[k][1], 32));
+            lo = _mm_shuffle_epi32(lo, _MM_SHUFFLE(3, 1, 2, 0));
+            hi = _mm_shuffle_epi32(hi, _MM_SHUFFLE(3, 1, 2, 0));
+            _mm_storeu_si128((__m128i *)(out + k * bw + bx), _mm_unpacklo_epi64(lo, hi));
+        }
+    }
+#endif
+    for (; bx < bw; bx++) {
+        int32_t s[5] = {0};
+        for (int r = 0; r < 4; r++) {
+            for (int x = 4 * bx; x < 4 * bx + 4; x++) {
+                int a = sc->lumaA[r * w + x];
+                int b = sc->lumaB[r * w + x];
+                s[0] += a;
+                s[1] += b;
+                s[2] += a * a;
+                s[3] += b * b;
+                s[4] += a * b;
+            }
+        }
+        for (int k = 0; k < 5; k++) {
+            out[k * bw + bx] = s[k];
+        }
+    }
+}
+
+/**
+ *  This function scores every 8x8 window formed by two rows of 4x4 blocks
+ *  (windows step by 4 pixels) and adds the results to the scale's totals.
+ *      @param sc       - scale to update
+ *      @param prev     - block sums of the upper block row
+ *      @param cur      - block sums of the lower block row
+ */
+static void score_windows(CompareScale *sc, const int32_t *prev, const int32_t *cur) {
+    int bw = sc->blocksWide;
+    for (int bx = 1; bx < bw; bx++) {
+        double s[5];
+        for (int k = 0; k < 5; k++) {
+            const int32_t *p = prev + k * bw;
+            const int32_t *c = cur + k * bw;
+            s[k] = (double)(p[bx - 1] + p[bx] + c[bx - 1] + c[bx]) / 64.0;
+        }
+
+        double ma  = s[0];
+        double mb  = s[1];
+        double va  = s[2] - ma * ma;
+        double vb  = s[3] - mb * mb;
+        double cov = s[4] - ma * mb;
+        double l   = (2.0 * ma * mb + SSIM_C1) / (ma * ma + mb * mb + SSIM_C1);
+        double cs  = (2.0 * cov + SSIM_C2) / (va + vb + SSIM_C2);
+
+        sc->ssimSum += l * cs;
+        sc->csSum   += cs;
+        sc->windows++;
+    }
+}
+
+/**
+ *  This function takes the luma row just written into the next free row
+ *  of a scale. Every second row is paired with the one above it and reduced
+ *  into the next scale, and every fourth row completes a row of blocks.
+ *      @param cmp      - comparison to update
+ *      @param s        - scale the row was written to
+ */
+static void scale_add_row(ImageCompare *cmp, int s) {
+    CompareScale *sc = &cmp->scale[s];
+    int slot = sc->rowsBuffered;
+
+    if ((slot & 1) && s + 1 < cmp->scales) {
+        CompareScale *next = &cmp->scale[s + 1];
+        size_t nextSlot = (size_t)next->rowsBuffered * next->width;
+        downscale_2x(sc->lumaA + (size_t)(slot - 1) * sc->width, sc->width, 2, 1, next->lumaA + nextSlot);
+        downscale_2x(sc->lumaB + (size_t)(slot - 1) * sc->width, sc->width, 2, 1, next->lumaB + nextSlot);
+        scale_add_row(cmp, s + 1);
+    }
+
+    if (++sc->rowsBuffered < 4) {
+        return;
+    }
+    sc->rowsBuffered = 0;
+
+    size_t blockSums = 5 * (size_t)sc->blocksWide;
+    int32_t *cur = sc->sums + (sc->blockRow & 1) * blockSums;
+    block_sums(sc, cur);
+
+    /* Windows whose lower block row starts above firstCountedRow belong to the band above */
+    int imageBlockRow = (cmp->rowOffset >> s) / 4 + sc->blockRow;
+    if (sc->blockRow > 0 && imageBlockRow * 4 >= (cmp->firstCountedRow >> s)) {
+        score_windows(sc, sc->sums + ((sc->blockRow - 1) & 1) * blockSums, cur);
+    }
+    sc->blockRow++;
+}
+
+/**
+ *  This function releases the buffers of a comparison.
+ *      @param cmp      - comparison to release
+ */
+static void compare_free(ImageCompare *cmp) {
+    for (int s = 0; s < METRICS_MAX_SCALES; s++) {
+        free(cmp->scale[s].lumaA);
+        free(cmp->scale[s].lumaB);
+        free(cmp->scale[s].sums);
+        cmp->scale[s].lumaA = NULL;
+        cmp->scale[s].lumaB = NULL;
+        cmp->scale[s].sums  = NULL;
+    }
+}
+
+/**
+ *  This function prepares a streaming comparison of two images of the same
+ *  size. Rows of both images are then given to compare_rows from top to bottom,
+ *  so only a few rows of each image need to be in memory at a time.
+ *      @param cmp          - comparison to initialize
+ *      @param width        - width in pixels of both images (at least 8)
+ *      @param height       - height in pixels of both images (at least 8)
+ *      @param components   - number of color channels (3 for RGB, 1 for grayscale)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compare_begin(ImageCompare *cmp, int width, int height, int components) {
+    memset(cmp, 0, sizeof(ImageCompare));
+    if (width < METRICS_MIN_DIMENSION || height < METRICS_MIN_DIMENSION) {
+        fprintf(stderr, "Images must be at least %dx%d pixels to compare\n", METRICS_MIN_DIMENSION, METRICS_MIN_DIMENSION);
+        return -1;
+    }
+    if (components != 1 && components != 3) {
+        fprintf(stderr, "Unsupported number of components for comparison\n");
+        return -1;
+    }
+
+    cmp->width      = width;
+    cmp->height     = height;
+    cmp->components = components;
+
+    /* Use as many scales as still fit one SSIM window */
+    int shortEdge = (width < height) ? width : height;
+    cmp->scales = 1;
+    while (cmp->scales < METRICS_MAX_SCALES && (shortEdge >> cmp->scales) >= METRICS_MIN_DIMENSION) {
+        cmp->scales++;
+    }
+
+    for (int s = 0; s < cmp->scales; s++) {
+        CompareScale *sc = &cmp->scale[s];
+        sc->width       = width >> s;
+        sc->blocksWide  = sc->width / 4;
+        sc->lumaA       = (uint8_t *)malloc(4 * (size_t)sc->width);
+        sc->lumaB       = (uint8_t *)malloc(4 * (size_t)sc->width);
+        sc->sums        = (int32_t *)malloc(2 * 5 * (size_t)sc->blocksWide * sizeof(int32_t));
+        if (!sc->lumaA || !sc->lumaB || !sc->sums) {
+            fprintf(stderr, "Failed to allocate memory for comparison\n");
+            compare_free(cmp);
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  This function adds the next rows of both images to a comparison.
+ *      @param cmp      - comparison started with compare_begin
+ *      @param rowsA    - interleaved pixel data of the first image (numRows rows, top to bottom)
+ *      @param rowsB    - interleaved pixel data of the second image (numRows rows, top to bottom)
+ *      @param numRows  - number of rows given
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compare_rows(ImageCompare *cmp, const uint8_t *rowsA, const uint8_t *rowsB, int numRows) {
+    if (cmp->rowOffset + cmp->rowsFed + numRows > cmp->height) {
+        fprintf(stderr, "More rows given than the images contain\n");
+        return -1;
+    }
+
+    size_t rowBytes = (size_t)cmp->width * cmp->components;
+    CompareScale *sc = &cmp->scale[0];
+    for (int r = 0; r < numRows; r++) {
+        const uint8_t *a = rowsA + r * rowBytes;
+        const uint8_t *b = rowsB + r * rowBytes;
+
+        if (cmp->rowOffset + cmp->rowsFed >= cmp->firstCountedRow) {
+            cmp->sqErr      += squared_error(a, b, rowBytes);
+            cmp->samples    += rowBytes;
+        }
+
+        uint8_t *lumaA = sc->lumaA + (size_t)sc->rowsBuffered * sc->width;
+        uint8_t *lumaB = sc->lumaB + (size_t)sc->rowsBuffered * sc->width;
+        if (cmp->components == 3) {
+            rgb_to_luma(a, lumaA, cmp->width);
+            rgb_to_luma(b, lumaB, cmp->width);
+        } else {
+            memcpy(lumaA, a, cmp->width);
+            memcpy(lumaB, b, cmp->width);
+        }
+        scale_add_row(cmp, 0);
+        cmp->rowsFed++;
+    }
+
+    return 0;
+}
+
+/**
+ *  This function adds the totals of one comparison into another
+ *  (used to combine bands compared on separate threads).
+ *      @param dst      - comparison to add into
+ *      @param src      - comparison to add
+ */
+static void compare_merge(ImageCompare *dst, const ImageCompare *src) {
+    dst->sqErr      += src->sqErr;
+    dst->samples    += src->samples;
+    for (int s = 0; s < dst->scales; s++) {
+        dst->scale[s].ssimSum   += src->scale[s].ssimSum;
+        dst->scale[s].csSum     += src->scale[s].csSum;
+        dst->scale[s].windows   += src->scale[s].windows;
+    }
+}
+
+/**
+ *  This function computes the final metrics of a comparison and releases it.
+ *      @param cmp      - comparison that has been given every row of both images
+ *      @param quality  - ImageQuality struct to populate
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compare_finish(ImageCompare *cmp, ImageQuality *quality) {
+    compare_free(cmp);
+    if (cmp->samples == 0 || cmp->scale[0].windows == 0) {
+        fprintf(stderr, "No rows were compared\n");
+        return -1;
+    }
+
+    quality->mse    = (double)cmp->sqErr / (double)cmp->samples;
+    quality->psnr   = (cmp->sqErr == 0) ? INFINITY : 10.0 * log10(255.0 * 255.0 / quality->mse);
+    quality->ssim   = cmp->scale[0].ssimSum / (double)cmp->scale[0].windows;
+
+    /* Contrast-structure at every scale but the last, full SSIM at the last; weights renormalized */
+    double weightSum = 0.0;
+    for (int s = 0; s < cmp->scales; s++) {
+        weightSum += msSsimWeights[s];
+    }
+    double msSsim = 1.0;
+    for (int s = 0; s < cmp->scales; s++) {
+        CompareScale *sc = &cmp->scale[s];
+        double value = (s == cmp->scales - 1) ? sc->ssimSum : sc->csSum;
+        value = (sc->windows > 0) ? value / (double)sc->windows : 1.0;
+        if (value < 0.0) value = 0.0;
+        msSsim *= pow(value, msSsimWeights[s] / weightSum);
+    }
+    quality->msSsim = msSsim;
+
+    return 0;
+}
+
+/* Work assigned to one thread of compare_image_buffers */
+typedef struct {
+    const uint8_t *imageA;
+    const uint8_t *imageB;
+    int            lastRow;
+    int            status;
+    ImageCompare   cmp;
+} CompareJob;
+
+static void *compare_worker(void *arg) {
+    CompareJob *job = (CompareJob *)arg;
+    size_t rowBytes = (size_t)job->cmp.width * job->cmp.components;
+    int first = job->cmp.rowOffset;
+
+    job->status = compare_rows(&job->cmp, job->imageA + first * rowBytes, job->imageB + first * rowBytes, job->lastRow - first);
+    return NULL;
+}
+
+/**
+ *  This function compares two images held in memory. Large images are split
+ *  into horizontal bands compared on separate threads; each band also reads
+ *  the rows just above it so windows that straddle band edges are counted
+ *  exactly once, and the result matches a single streaming pass.
+ *      @param imageA       - interleaved pixel data of the first image (RGB or grayscale, top to bottom)
+ *      @param imageB       - interleaved pixel data of the second image
+ *      @param width        - width in pixels of both images
+ *      @param height       - height in pixels of both images
+ *      @param components   - number of color channels (3 for RGB, 1 for grayscale)
+ *      @param quality      - ImageQuality struct to populate
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compare_image_buffers(const uint8_t *imageA, const uint8_t *imageB, int width, int height, int components, ImageQuality *quality) {
+    if (!imageA || !imageB || !quality) {
+        fprintf(stderr, "Invalid arguments for image comparison\n");
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = height / METRICS_ROWS_PER_THREAD;
+    if (threads > cpus)                 threads = (int)cpus;
+    if (threads > METRICS_MAX_THREADS)  threads = METRICS_MAX_THREADS;
+    if (threads < 1)                    threads = 1;
+
+    CompareJob *jobs = (CompareJob *)calloc(threads, sizeof(CompareJob));
+    if (!jobs) {
+        fprintf(stderr, "Failed to allocate memory for comparison\n");
+        return -1;
+    }
+
+    pthread_t tids[METRICS_MAX_THREADS];
+    int started[METRICS_MAX_THREADS] = {0};
+    int status = 0;
+    int ready = 0;
+    for (int t = 0; t < threads; t++) {
+        int firstRow = (int)((int64_t)height * t / threads) / METRICS_BAND_ALIGN * METRICS_BAND_ALIGN;
+        int lastRow  = (t == threads - 1) ? height
+                     : (int)((int64_t)height * (t + 1) / threads) / METRICS_BAND_ALIGN * METRICS_BAND_ALIGN;
+
+        if (compare_begin(&jobs[t].cmp, width, height, components) == -1) {
+            status = -1;
+            break;
+        }
+        ready++;
+        jobs[t].imageA              = imageA;
+        jobs[t].imageB              = imageB;
+        jobs[t].lastRow             = lastRow;
+        jobs[t].cmp.rowOffset       = (firstRow > METRICS_BAND_ALIGN) ? firstRow - METRICS_BAND_ALIGN : 0;
+        jobs[t].cmp.firstCountedRow = firstRow;
+
+        // band 0 runs on the calling thread; fall back to serial work if a thread fails to start
+        if (t > 0 && pthread_create(&tids[t], NULL, compare_worker, &jobs[t]) == 0) {
+            started[t] = 1;
+        }
+    }
+
+    for (int t = 0; t < ready; t++) {
+        if (started[t]) {
+            pthread_join(tids[t], NULL);
+        } else if (status == 0) {
+            compare_worker(&jobs[t]);
+        }
+        if (jobs[t].status == -1) {
+            status = -1;
+        }
+        if (t > 0) {
+            compare_merge(&jobs[0].cmp, &jobs[t].cmp);
+            compare_free(&jobs[t].cmp);
+        }
+    }
+
+    if (status == 0) {
+        status = compare_finish(&jobs[0].cmp, quality);
+    } else if (ready > 0) {
+        compare_free(&jobs[0].cmp);
+    }
+
+    free(jobs);
+    return status;
+}
+
+/* Source of pixel rows (top to bottom, RGB or grayscale) read incrementally from a BMP or JPEG file */
+typedef struct {
+    int      isJpeg;
+    FILE    *file;
+    int      width;
+    int      height;
+    int      components;
+    int      row;
+    long     pixelOffset;       // BMP: offset of the pixel data
+    int      rowSize;           // BMP: padded bytes per row in the file
+    struct jpeg_decompress_struct cinfo;
+    struct jpeg_error_mgr jerr;
+} RowReader;
+
+/**
+ *  This function opens a BMP or JPEG file (detected by its signature)
+ *  for reading one row at a time.
+ *      @param reader       - RowReader struct to initialize
+ *      @param filename     - name of file to read
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+static int reader_open(RowReader *reader, const char *filename) {
+    memset(reader, 0, sizeof(RowReader));
+
+    reader->file = fopen(filename, "rb");
+    if (!reader->file) {
+        fprintf(stderr, "Failed to open file\n");
+        return -1;
+    }
+
+    uint8_t signature[2] = {0};
+    fread(signature, 1, 2, reader->file);
+    rewind(reader->file);
+
+    if (signature[0] == 0xFF && signature[1] == 0xD8) {
+        reader->isJpeg = 1;
+        reader->cinfo.err = jpeg_std_error(&reader->jerr);
+        jpeg_create_decompress(&reader->cinfo);
+        jpeg_stdio_src(&reader->cinfo, reader->file);
+        jpeg_read_header(&reader->cinfo, TRUE);
+        jpeg_start_decompress(&reader->cinfo);
+
+        reader->width       = reader->cinfo.output_width;
+        reader->height      = reader->cinfo.output_height;
+        reader->components  = reader->cinfo.out_color_components;
+        return 0;
+    }
+
+    BMPHeader bmpHeader;
+    DIBHeader dibHeader;
+    if (get_bmp_headers(filename, &bmpHeader, &dibHeader) == -1) {
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+    if (dibHeader.bitsPerPixel != 24 && dibHeader.bitsPerPixel != 8) {
+        fprintf(stderr, "Unsupported color space\n");
+        fclose(reader->file);
+        reader->file = NULL;
+        return -1;
+    }
+
+    reader->width       = dibHeader.width;
+    reader->height      = dibHeader.height;
+    reader->components  = dibHeader.bitsPerPixel / 8;
+    reader->pixelOffset = bmpHeader.bfOffBits;
+    reader->rowSize     = ((dibHeader.bitsPerPixel * dibHeader.width + 31) / 32) * 4;
+    return 0;
+}
+
+/**
+ *  This function reads the next rows of a file, converting BMP rows to top-to-bottom RGB order.
+ *      @param reader   - RowReader opened with reader_open
+ *      @param rows     - buffer for numRows rows of width * components bytes
+ *      @param numRows  - number of rows to read
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+static int reader_read(RowReader *reader, uint8_t *rows, int numRows) {
+    size_t rowBytes = (size_t)reader->width * reader->components;
+
+    for (int r = 0; r < numRows; r++, reader->row++) {
+        uint8_t *row = rows + r * rowBytes;
+
+        if (reader->isJpeg) {
+            JSAMPROW rowPointer[1] = {row};
+            if (jpeg_read_scanlines(&reader->cinfo, rowPointer, 1) != 1) {
+                fprintf(stderr, "Failed to read JPEG scanline\n");
+                return -1;
+            }
+            continue;
+        }
+
+        /* BMP rows are stored bottom to top in BGR order */
+        long offset = reader->pixelOffset + (long)(reader->height - 1 - reader->row) * reader->rowSize;
+        if (fseek(reader->file, offset, SEEK_SET) != 0 || fread(row, rowBytes, 1, reader->file) != 1) {
+            fprintf(stderr, "Failed to read BMP row\n");
+            return -1;
+        }
+        if (reader->components == 3) {
+            for (int x = 0; x < reader->width; x++) {
+                uint8_t blue    = row[3 * x];
+                row[3 * x]      = row[3 * x + 2];
+                row[3 * x + 2]  = blue;
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  This function closes a RowReader.
+ *      @param reader   - RowReader to close
+ *      @param finished - non-zero if every row of a JPEG was read
+ */
+static void reader_close(RowReader *reader, int finished) {
+    if (reader->isJpeg) {
+        if (finished) {
+            jpeg_finish_decompress(&reader->cinfo);
+        }
+        jpeg_destroy_decompress(&reader->cinfo);
+    }
+    if (reader->file) {
+        fclose(reader->file);
+    }
+}
+
+/**
+ *  This function compares two image files (BMP or JPEG, in any combination).
+ *  Both files are read a few rows at a time, so neither image is ever
+ *  fully held in memory.
+ *      @param fileA    - name of the first (reference) image file
+ *      @param fileB    - name of the second image file
+ *      @param quality  - ImageQuality struct to populate
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compare_image_files(const char *fileA, const char *fileB, ImageQuality *quality) {
+    RowReader readerA;
+    RowReader readerB;
+
+    if (reader_open(&readerA, fileA) == -1) {
+        return -1;
+    }
+    if (reader_open(&readerB, fileB) == -1) {
+        reader_close(&readerA, 0);
+        return -1;
+    }
+
+    if (readerA.width != readerB.width || readerA.height != readerB.height || readerA.components != readerB.components) {
+        fprintf(stderr, "Images differ in size or color space\n");
+        reader_close(&readerA, 0);
+        reader_close(&readerB, 0);
+        return -1;
+    }
+
+    ImageCompare cmp;
+    if (compare_begin(&cmp, readerA.width, readerA.height, readerA.components) == -1) {
+        reader_close(&readerA, 0);
+        reader_close(&readerB, 0);
+        return -1;
+    }
+
+    size_t chunkBytes = (size_t)METRICS_CHUNK_ROWS * readerA.width * readerA.components;
+    uint8_t *rowsA = (uint8_t *)malloc(chunkBytes);
+    uint8_t *rowsB = (uint8_t *)malloc(chunkBytes);
+    int status = (rowsA && rowsB) ? 0 : -1;
+    if (status == -1) {
+        fprintf(stderr, "Failed to allocate memory for comparison rows\n");
+    }
+
+    for (int y = 0; status == 0 && y < readerA.height; y += METRICS_CHUNK_ROWS) {
+        int numRows = (readerA.height - y < METRICS_CHUNK_ROWS) ? readerA.height - y : METRICS_CHUNK_ROWS;
+        if (reader_read(&readerA, rowsA, numRows) == -1 ||
+            reader_read(&readerB, rowsB, numRows) == -1 ||
+            compare_rows(&cmp, rowsA, rowsB, numRows) == -1) {
+            status = -1;
+        }
+    }
+
+    if (status == 0) {
+        status = compare_finish(&cmp, quality);
+    } else {
+        compare_free(&cmp);
+    }
+
+    reader_close(&readerA, status == 0);
+    reader_close(&readerB, status == 0);
+    free(rowsA);
+    free(rowsB);
+    return status;
+}
@@ -0,0 +1,212 @@
+/* resize.c */
+
+#include "resize.h"
+#include "simd.h"
+
+#include <math.h>
+
+/* Contributing source range for one output pixel of resize_area */
+typedef struct {
+    int first;
+    int count;
+} AreaSpan;
+
+/**
+ *  This function reduces an image to half its width and height by
+ *  averaging every 2x2 square of pixels (box filter). An odd last
+ *  row or column is dropped.
+ *      @param src          - interleaved pixel data (RGB or grayscale, top to bottom)
+ *      @param width        - width in pixels of src
+ *      @param height       - height in pixels of src
+ *      @param components   - number of color channels (3 for RGB, 1 for grayscale)
+ *      @param dst          - output pixel data, (width / 2) * (height / 2) pixels
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int downscale_2x(const uint8_t *src, int width, int height, int components, uint8_t *dst) {
+    if (width < 2 || height < 2 || (components != 1 && components != 3)) {
+        fprintf(stderr, "Invalid arguments for 2x downscale\n");
+        return -1;
+    }
+
+    int dstWidth    = width / 2;
+    int dstHeight   = height / 2;
+    size_t srcRow   = (size_t)width * components;
+    size_t dstRow   = (size_t)dstWidth * components;
+
+    for (int y = 0; y < dstHeight; y++) {
+        const uint8_t *r0 = src + (size_t)(2 * y) * srcRow;
+        const uint8_t *r1 = r0 + srcRow;
+        uint8_t *out = dst + (size_t)y * dstRow;
+        int x = 0;     // output pixel
+
+#ifdef __SSE2__
+        const __m128i two = _mm_set1_epi16(2);
+        if (components == 3) {
+            /* 32 source pixels -> 16 output pixels; even + odd of both rows is the 2x2 sum */
+            for (; x + 16 <= dstWidth; x += 16) {
+                __m128i sum[2][3];
+                for (int half = 0; half < 2; half++) {
+                    __m128i e0[3], o0[3], e1[3], o1[3];
+                    deinterleave16(r0 + (size_t)(2 * x + 16 * half) * 3, e0, o0);
+                    deinterleave16(r1 + (size_t)(2 * x + 16 * half) * 3, e1, o1);
+                    for (int c = 0; c < 3; c++) {
+                        __m128i s = _mm_add_epi16(_mm_add_epi16(e0[c], o0[c]), _mm_add_epi16(e1[c], o1[c]));
+                        sum[half][c] = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+                    }
+                }
+                interleave16(_mm_packus_epi16(sum[0][0], sum[1][0]),
+                             _mm_packus_epi16(sum[0][1], sum[1][1]),
+                             _mm_packus_epi16(sum[0][2], sum[1][2]), out + (size_t)x * 3);
+            }
+        } else {
+            /* 32 source pixels -> 16 output pixels; even bytes are the low half of each 16-bit lane */
+            const __m128i lowByte = _mm_set1_epi16(0x00FF);
+            for (; x + 16 <= dstWidth; x += 16) {
+                __m128i avg[2];
+                for (int half = 0; half < 2; half++) {
+                    __m128i a = _mm_loadu_si128((const __m128i *)(r0 + 2 * x + 16 * half));
+                    __m128i b = _mm_loadu_si128((const __m128i *)(r1 + 2 * x + 16 * half));
+                    __m128i s = _mm_add_epi16(_mm_add_epi16(_mm_and_si128(a, lowByte), _mm_srli_epi16(a, 8)),
+                                              _mm_add_epi16(_mm_and_si128(b, lowByte), _mm_srli_epi16(b, 8)));
+                    avg[half] = _mm_srli_epi16(_mm_add_epi16(s, two), 2);
+                }
+                _mm_storeu_si128((__m128i *)(out + x), _mm_packus_epi16(avg[0], avg[1]));
+            }
+        }
+#endif
+        for (; x < dstWidth; x++) {
+            for (int c = 0; c < components; c++) {
+                size_t i = (size_t)(2 * x) * components + c;
+                out[(size_t)x * components + c] = (uint8_t)((r0[i] + r0[i + components] + r1[i] + r1[i + components] + 2) >> 2);
+            }
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  This function computes, for each output position along one axis, the
+ *  source positions it covers and how much of each one it covers.
+ *      @param srcLen       - length of the axis in the source
+ *      @param dstLen       - length of the axis in the output
+ *      @param spans        - first source position and number of positions for each output --- returned via pointer
+ *      @param maxTaps      - weights stored per output position --- returned via pointer
+ *
+ *      @return weights (dstLen * maxTaps, each row summing to 1) or NULL on failure --- freed by caller
+ */
+static float *area_weights(int srcLen, int dstLen, AreaSpan *spans, int *maxTaps) {
+    double scale = (double)srcLen / dstLen;
+    int taps = (int)ceil(scale) + 1;
+    float *weights = (float *)calloc((size_t)dstLen * taps, sizeof(float));
+    if (!weights) {
+        return NULL;
+    }
+
+    for (int i = 0; i < dstLen; i++) {
+        double start    = i * scale;
+        double end      = (i + 1) * scale;
+        int first       = (int)floor(start);
+        int last        = (int)ceil(end);
+        if (last > srcLen) last = srcLen;
+        if (last - first > taps) last = first + taps;
+
+        spans[i].first = first;
+        spans[i].count = last - first;
+        for (int j = first; j < last; j++) {
+            double lo = (start > j) ? start : j;
+            double hi = (end < j + 1) ? end : j + 1;
+            weights[(size_t)i * taps + (j - first)] = (float)((hi - lo) / scale);
+        }
+    }
+
+    *maxTaps = taps;
+    return weights;
+}
+
+/**
+ *  This function resizes an image to arbitrary dimensions by averaging
+ *  the source area each output pixel covers (area / box filter).
+ *  Each source row is resampled horizontally once and blended into
+ *  the output rows it overlaps.
+ *      @param src          - interleaved pixel data (RGB or grayscale, top to bottom)
+ *      @param srcWidth     - width in pixels of src
+ *      @param srcHeight    - height in pixels of src
+ *      @param components   - number of color channels (3 for RGB, 1 for grayscale)
+ *      @param dst          - output pixel data, dstWidth * dstHeight pixels
+ *      @param dstWidth     - width in pixels of dst
+ *      @param dstHeight    - height in pixels of dst
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int resize_area(const uint8_t *src, int srcWidth, int srcHeight, int components, uint8_t *dst, int dstWidth, int dstHeight) {
+    if (srcWidth <= 0 || srcHeight <= 0 || dstWidth <= 0 || dstHeight <= 0) {
+        fprintf(stderr, "Invalid dimensions for resize\n");
+        return -1;
+    }
+
+    AreaSpan *xSpans    = (AreaSpan *)malloc(dstWidth * sizeof(AreaSpan));
+    AreaSpan *ySpans    = (AreaSpan *)malloc(dstHeight * sizeof(AreaSpan));
+    size_t rowLen       = (size_t)dstWidth * components;
+    float *hrow         = (float *)malloc(rowLen * sizeof(float));
+    float *acc          = (float *)malloc(rowLen * sizeof(float));
+    int xTaps = 0;
+    int yTaps = 0;
+    float *xWeights     = xSpans ? area_weights(srcWidth, dstWidth, xSpans, &xTaps) : NULL;
+    float *yWeights     = ySpans ? area_weights(srcHeight, dstHeight, ySpans, &yTaps) : NULL;
+    if (!xSpans || !ySpans || !hrow || !acc || !xWeights || !yWeights) {
+        fprintf(stderr, "Failed to allocate memory for resize\n");
+        free(xSpans);
+        free(ySpans);
+        free(hrow);
+        free(acc);
+        free(xWeights);
+        free(yWeights);
+        return -1;
+    }
+
+    int cachedRow = -1;     // source row currently held in hrow (shared by neighbouring output rows)
+    for (int y = 0; y < dstHeight; y++) {
+        memset(acc, 0, rowLen * sizeof(float));
+
+        for (int t = 0; t < ySpans[y].count; t++) {
+            int sy = ySpans[y].first + t;
+            float wy = yWeights[(size_t)y * yTaps + t];
+
+            if (sy != cachedRow) {
+                const uint8_t *in = src + (size_t)sy * srcWidth * components;
+                for (int x = 0; x < dstWidth; x++) {
+                    const float *wx = xWeights + (size_t)x * xTaps;
+                    const uint8_t *p = in + (size_t)xSpans[x].first * components;
+                    for (int c = 0; c < components; c++) {
+                        float v = 0.0f;
+                        for (int k = 0; k < xSpans[x].count; k++) {
+                            v += wx[k] * p[k * components + c];
+                        }
+                        hrow[(size_t)x * components + c] = v;
+                    }
+                }
+                cachedRow = sy;
+            }
+
+            for (size_t i = 0; i < rowLen; i++) {
+                acc[i] += wy * hrow[i];
+            }
+        }
+
+        uint8_t *out = dst + (size_t)y * rowLen;
+        for (size_t i = 0; i < rowLen; i++) {
+            float v = acc[i] + 0.5f;
+            out[i] = (uint8_t)(v < 0.0f ? 0 : (v > 255.0f ? 255 : (int)v));
+        }
+    }
+
+    free(xSpans);
+    free(ySpans);
+    free(hrow);
+    free(acc);
+    free(xWeights);
+    free(yWeights);
+    return 0;
+}
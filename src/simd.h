@@ -0,0 +1,98 @@
+/* simd.h */
+
+/* SSE2 helpers shared by the pixel kernels --- internal to src/, not part of the public headers */
+
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <stdint.h>
+
+/* JFIF luma weights in 14-bit fixed point (sum to 16384) */
+#define FIX_Y_R     4899
+#define FIX_Y_G     9617
+#define FIX_Y_B     1868
+#define ROUND_14    (1 << 13)
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+
+/**
+ *  This function splits 16 interleaved 3-byte pixels into their components,
+ *  separating even and odd pixels (the layout 2x2 downsampling needs).
+ *      @param p        - 48 bytes of interleaved pixel data
+ *      @param even     - 16-bit components of pixels 0, 2, ..., 14 --- returned via pointer (3 vectors)
+ *      @param odd      - 16-bit components of pixels 1, 3, ..., 15 --- returned via pointer (3 vectors)
+ */
+static inline void deinterleave16(const uint8_t *p, __m128i even[3], __m128i odd[3]) {
+    const __m128i zero = _mm_setzero_si128();
+    __m128i a = _mm_loadu_si128((const __m128i *)p);
+    __m128i f = _mm_loadu_si128((const __m128i *)(p + 16));
+    __m128i b = _mm_loadu_si128((const __m128i *)(p + 32));
+
+    /* Three rounds of shift/unpack halve the interleave distance each time */
+    __m128i g = _mm_srli_si128(a, 8);   a = _mm_slli_si128(a, 8);
+    a = _mm_unpackhi_epi8(a, f);        f = _mm_slli_si128(f, 8);
+    g = _mm_unpacklo_epi8(g, b);        f = _mm_unpackhi_epi8(f, b);
+    __m128i d = _mm_srli_si128(a, 8);   a = _mm_slli_si128(a, 8);
+    a = _mm_unpackhi_epi8(a, g);        g = _mm_slli_si128(g, 8);
+    d = _mm_unpacklo_epi8(d, f);        g = _mm_unpackhi_epi8(g, f);
+    __m128i e = _mm_srli_si128(a, 8);   a = _mm_slli_si128(a, 8);
+    a = _mm_unpackhi_epi8(a, d);        d = _mm_slli_si128(d, 8);
+    e = _mm_unpacklo_epi8(e, g);        d = _mm_unpackhi_epi8(d, g);
+
+    // a = (c0 even, c1 even), e = (c2 even, c0 odd), d = (c1 odd, c2 odd)
+    even[0] = _mm_unpacklo_epi8(a, zero);
+    even[1] = _mm_unpackhi_epi8(a, zero);
+    even[2] = _mm_unpacklo_epi8(e, zero);
+    odd[0]  = _mm_unpackhi_epi8(e, zero);
+    odd[1]  = _mm_unpacklo_epi8(d, zero);
+    odd[2]  = _mm_unpackhi_epi8(d, zero);
+}
+
+/**
+ *  This function packs 4 pixels held in 32-bit lanes (3 bytes + 1 unused)
+ *  down to 12 consecutive bytes in the low end of the register.
+ */
+static inline __m128i pack_pixels4(__m128i q) {
+    const __m128i keep0 = _mm_set_epi32(0, 0x00FFFFFF, 0, 0x00FFFFFF);
+    const __m128i keep1 = _mm_set_epi32(0x0000FFFF, 0xFF000000, 0x0000FFFF, 0xFF000000);
+    __m128i t = _mm_or_si128(_mm_and_si128(q, keep0), _mm_and_si128(_mm_srli_epi64(q, 8), keep1));
+    return _mm_or_si128(_mm_move_epi64(t), _mm_slli_si128(_mm_unpackhi_epi64(t, _mm_setzero_si128()), 6));
+}
+
+/**
+ *  This function interleaves three 16-byte component vectors into
+ *  16 consecutive 3-byte pixels.
+ *      @param c0, c1, c2   - components in pixel order (first, second and third byte of each pixel)
+ *      @param out          - 48 bytes of interleaved pixel data to fill
+ */
+static inline void interleave16(__m128i c0, __m128i c1, __m128i c2, uint8_t *out) {
+    const __m128i zero = _mm_setzero_si128();
+
+    /* 4 pixels per 32-bit lane, then squeeze out the spare byte */
+    __m128i lo01 = _mm_unpacklo_epi8(c0, c1);
+    __m128i hi01 = _mm_unpackhi_epi8(c0, c1);
+    __m128i lo2  = _mm_unpacklo_epi8(c2, zero);
+    __m128i hi2  = _mm_unpackhi_epi8(c2, zero);
+    __m128i q0 = pack_pixels4(_mm_unpacklo_epi16(lo01, lo2));
+    __m128i q1 = pack_pixels4(_mm_unpackhi_epi16(lo01, lo2));
+    __m128i q2 = pack_pixels4(_mm_unpacklo_epi16(hi01, hi2));
+    __m128i q3 = pack_pixels4(_mm_unpackhi_epi16(hi01, hi2));
+    _mm_storeu_si128((__m128i *)out,        _mm_or_si128(q0, _mm_slli_si128(q1, 12)));
+    _mm_storeu_si128((__m128i *)(out + 16), _mm_or_si128(_mm_srli_si128(q1, 4), _mm_slli_si128(q2, 8)));
+    _mm_storeu_si128((__m128i *)(out + 32), _mm_or_si128(_mm_srli_si128(q2, 8), _mm_slli_si128(q3, 4)));
+}
+
+/* 8 luma values (16-bit) from 8 R, G, B samples */
+static inline __m128i luma8(__m128i r, __m128i g, __m128i b) {
+    const __m128i kRG = _mm_set_epi16(FIX_Y_G, FIX_Y_R, FIX_Y_G, FIX_Y_R, FIX_Y_G, FIX_Y_R, FIX_Y_G, FIX_Y_R);
+    const __m128i kB1 = _mm_set_epi16(ROUND_14, FIX_Y_B, ROUND_14, FIX_Y_B, ROUND_14, FIX_Y_B, ROUND_14, FIX_Y_B);
+    const __m128i one = _mm_set1_epi16(1);
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(r, g), kRG), _mm_madd_epi16(_mm_unpacklo_epi16(b, one), kB1));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(r, g), kRG), _mm_madd_epi16(_mm_unpackhi_epi16(b, one), kB1));
+    return _mm_packs_epi32(_mm_srai_epi32(lo, 14), _mm_srai_epi32(hi, 14));
+}
+
+#endif
+
+#endif
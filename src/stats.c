@@ -0,0 +1,311 @@
+/* stats.c */
+
+#include "stats.h"
+
+#include <pthread.h>
+#include <unistd.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+#define STATS_MAX_THREADS           16
+#define STATS_PIXELS_PER_THREAD     (1 << 18)   // below this, thread start-up costs more than it saves
+
+/**
+ *  This function adds one array of histogram counts into another.
+ *      @param dst      - counts to add into
+ *      @param src      - counts to add
+ *      @param n        - number of counts in each array
+ */
+static void add_counts(uint32_t *dst, const uint32_t *src, int n) {
+    int i = 0;
+#ifdef __SSE2__
+    for (; i + 4 <= n; i += 4) {
+        __m128i a = _mm_loadu_si128((const __m128i *)(dst + i));
+        __m128i b = _mm_loadu_si128((const __m128i *)(src + i));
+        _mm_storeu_si128((__m128i *)(dst + i), _mm_add_epi32(a, b));
+    }
+#endif
+    for (; i < n; i++) {
+        dst[i] += src[i];
+    }
+}
+
+/**
+ *  This function folds every sub-histogram of an accumulator into
+ *  the first one and clears the rest.
+ *      @param acc      - accumulator to collapse
+ */
+static void collapse_subhistograms(StatsAccumulator *acc) {
+    int n = STATS_MAX_CHANNELS * 256;
+    for (int s = 1; s < STATS_SUBHISTOGRAMS; s++) {
+        add_counts(&acc->sub[0][0][0], &acc->sub[s][0][0], n);
+        memset(acc->sub[s], 0, sizeof(acc->sub[s]));
+    }
+}
+
+/**
+ *  This function prepares an accumulator to collect statistics.
+ *      @param acc          - accumulator to initialize
+ *      @param components   - number of color channels per pixel (3 for RGB/BGR, 1 for grayscale)
+ *      @param bgr          - non-zero if rows will be given in BGR order (as stored by BMP)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int stats_begin(StatsAccumulator *acc, int components, int bgr) {
+    if (components != 1 && components != 3) {
+        fprintf(stderr, "Unsupported number of components for statistics\n");
+        return -1;
+    }
+
+    memset(acc, 0, sizeof(StatsAccumulator));
+    acc->components = components;
+    acc->bgr        = (components == 3) ? bgr : 0;
+    return 0;
+}
+
+/**
+ *  This function adds one row of interleaved pixel data to an accumulator.
+ *  Four consecutive pixels are counted into four separate sub-histograms so
+ *  that runs of identical values do not serialize on the same counter.
+ *      @param acc      - accumulator to update
+ *      @param row      - pixel data for the row (width * components bytes)
+ *      @param width    - width in pixels of the row
+ */
+void stats_accumulate_row(StatsAccumulator *acc, const uint8_t *row, int width) {
+    const uint8_t *p = row;
+    int x = 0;
+
+    if (acc->components == 3) {
+        for (; x + 4 <= width; x += 4, p += 12) {
+            acc->sub[0][0][p[0]]++;  acc->sub[0][1][p[1]]++;  acc->sub[0][2][p[2]]++;
+            acc->sub[1][0][p[3]]++;  acc->sub[1][1][p[4]]++;  acc->sub[1][2][p[5]]++;
+            acc->sub[2][0][p[6]]++;  acc->sub[2][1][p[7]]++;  acc->sub[2][2][p[8]]++;
+            acc->sub[3][0][p[9]]++;  acc->sub[3][1][p[10]]++; acc->sub[3][2][p[11]]++;
+        }
+        for (; x < width; x++, p += 3) {
+            acc->sub[0][0][p[0]]++;  acc->sub[0][1][p[1]]++;  acc->sub[0][2][p[2]]++;
+        }
+    } else {
+        for (; x + 4 <= width; x += 4, p += 4) {
+            acc->sub[0][0][p[0]]++;
+            acc->sub[1][0][p[1]]++;
+            acc->sub[2][0][p[2]]++;
+            acc->sub[3][0][p[3]]++;
+        }
+        for (; x < width; x++, p++) {
+            acc->sub[0][0][p[0]]++;
+        }
+    }
+
+    acc->pixelCount += width;
+}
+
+/**
+ *  This function merges the sub-histograms of an accumulator and derives
+ *  the min, max, mean and variance of each channel from the merged histogram.
+ *      @param acc      - accumulator holding the collected counts
+ *      @param stats    - ImageStats struct to populate (channels in RGB order)
+ */
+void stats_finish(StatsAccumulator *acc, ImageStats *stats) {
+    collapse_subhistograms(acc);
+
+    memset(stats, 0, sizeof(ImageStats));
+    stats->components = acc->components;
+    stats->pixelCount = acc->pixelCount;
+
+    for (int c = 0; c < acc->components; c++) {
+        int out = acc->bgr ? 2 - c : c;     // report BGR rows in RGB order
+        const uint32_t *hist = acc->sub[0][c];
+        memcpy(stats->histogram[out], hist, sizeof(stats->histogram[out]));
+
+        if (acc->pixelCount == 0) {
+            continue;
+        }
+
+        int lo = 0;
+        int hi = 255;
+        while (lo < 255 && hist[lo] == 0) lo++;
+        while (hi > 0 && hist[hi] == 0) hi--;
+
+        uint64_t sum    = 0;
+        uint64_t sumSq  = 0;
+        for (int v = lo; v <= hi; v++) {
+            sum     += (uint64_t)hist[v] * v;
+            sumSq   += (uint64_t)hist[v] * v * v;
+        }
+
+        double n    = (double)acc->pixelCount;
+        double mean = (double)sum / n;
+        stats->min[out]         = (uint8_t)lo;
+        stats->max[out]         = (uint8_t)hi;
+        stats->mean[out]        = mean;
+        stats->variance[out]    = (double)sumSq / n - mean * mean;
+    }
+}
+
+/* Work assigned to one thread of compute_image_stats */
+typedef struct {
+    const uint8_t    *image_buffer;
+    int               width;
+    int               firstRow;
+    int               lastRow;
+    StatsAccumulator *acc;
+} StatsJob;
+
+static void *stats_worker(void *arg) {
+    StatsJob *job = (StatsJob *)arg;
+    int rowSize = job->width * job->acc->components;
+
+    for (int y = job->firstRow; y < job->lastRow; y++) {
+        stats_accumulate_row(job->acc, job->image_buffer + (size_t)y * rowSize, job->width);
+    }
+    collapse_subhistograms(job->acc);      // merge this thread's copies while still running in parallel
+    return NULL;
+}
+
+/**
+ *  This function computes per-channel histograms and min/max/mean/variance
+ *  of an image buffer in a single pass. Large images are split into bands of
+ *  rows that are counted on separate threads and merged at the end.
+ *      @param image_buffer     - interleaved pixel data (RGB or grayscale, top to bottom)
+ *      @param width            - width in pixels of image
+ *      @param height           - height in pixels of image
+ *      @param components       - number of color channels (3 for RGB, 1 for grayscale)
+ *      @param stats            - ImageStats struct to populate
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int compute_image_stats(const uint8_t *image_buffer, int width, int height, int components, ImageStats *stats) {
+    if (!image_buffer || !stats || width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid arguments for image statistics\n");
+        return -1;
+    }
+
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+    int threads = (int)(((uint64_t)width * height) / STATS_PIXELS_PER_THREAD);
+    if (threads > cpus)                 threads = (int)cpus;
+    if (threads > STATS_MAX_THREADS)    threads = STATS_MAX_THREADS;
+    if (threads > height)               threads = height;
+    if (threads < 1)                    threads = 1;
+
+    StatsAccumulator *accs = (StatsAccumulator *)malloc(threads * sizeof(StatsAccumulator));
+    if (!accs) {
+        fprintf(stderr, "Failed to allocate memory for statistics\n");
+        return -1;
+    }
+
+    for (int t = 0; t < threads; t++) {
+        if (stats_begin(&accs[t], components, 0) == -1) {
+            free(accs);
+            return -1;
+        }
+    }
+
+    StatsJob jobs[STATS_MAX_THREADS];
+    pthread_t tids[STATS_MAX_THREADS];
+    int started = 0;
+    for (int t = 0; t < threads; t++) {
+        jobs[t].image_buffer    = image_buffer;
+        jobs[t].width           = width;
+        jobs[t].firstRow        = (int)((int64_t)height * t / threads);
+        jobs[t].lastRow         = (int)((int64_t)height * (t + 1) / threads);
+        jobs[t].acc             = &accs[t];
+
+        // thread 0 runs on the calling thread; fall back to serial work if a thread fails to start
+        if (t == 0 || pthread_create(&tids[t], NULL, stats_worker, &jobs[t]) != 0) {
+            continue;
+        }
+        started |= 1 << t;
+    }
+
+    for (int t = 0; t < threads; t++) {
+        if (!(started & (1 << t))) {
+            stats_worker(&jobs[t]);
+        }
+    }
+
+    for (int t = 1; t < threads; t++) {
+        if (started & (1 << t)) {
+            pthread_join(tids[t], NULL);
+        }
+        add_counts(&accs[0].sub[0][0][0], &accs[t].sub[0][0][0], STATS_MAX_CHANNELS * 256);
+        accs[0].pixelCount += accs[t].pixelCount;
+    }
+
+    stats_finish(&accs[0], stats);
+    free(accs);
+    return 0;
+}
+
+/**
+ *  This function stretches the contrast of each channel so that its
+ *  populated range spans the full 0-255 range (auto-levels).
+ *      @param image_buffer     - interleaved pixel data (RGB or grayscale) modified in place
+ *      @param width            - width in pixels of image
+ *      @param height           - height in pixels of image
+ *      @param components       - number of color channels (3 for RGB, 1 for grayscale)
+ *      @param stats            - statistics of image_buffer (from compute_image_stats or a decode)
+ *      @param clipPercent      - percentage of pixels to clip at each end of every channel (0 for pure min/max)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int auto_levels(uint8_t *image_buffer, int width, int height, int components, const ImageStats *stats, double clipPercent) {
+    if (!image_buffer || !stats || stats->components != components) {
+        fprintf(stderr, "Invalid arguments for auto levels\n");
+        return -1;
+    }
+    if (clipPercent < 0.0 || clipPercent >= 50.0) {
+        fprintf(stderr, "Clip percentage must be in the range [0, 50)\n");
+        return -1;
+    }
+
+    /* Build a lookup table per channel from the clipped histogram range */
+    uint8_t lut[STATS_MAX_CHANNELS][256];
+    uint64_t clip = (uint64_t)(stats->pixelCount * clipPercent / 100.0);
+    for (int c = 0; c < components; c++) {
+        const uint32_t *hist = stats->histogram[c];
+        uint64_t count = 0;
+        int lo = 0;
+        int hi = 255;
+
+        for (lo = 0; lo < 255; lo++) {
+            count += hist[lo];
+            if (count > clip) break;
+        }
+        count = 0;
+        for (hi = 255; hi > 0; hi--) {
+            count += hist[hi];
+            if (count > clip) break;
+        }
+
+        for (int v = 0; v < 256; v++) {
+            if (hi <= lo) {
+                lut[c][v] = (uint8_t)v;     // flat channel, nothing to stretch
+            } else if (v <= lo) {
+                lut[c][v] = 0;
+            } else if (v >= hi) {
+                lut[c][v] = 255;
+            } else {
+                lut[c][v] = (uint8_t)(((v - lo) * 255 + (hi - lo) / 2) / (hi - lo));
+            }
+        }
+    }
+
+    size_t pixels = (size_t)width * height;
+    uint8_t *p = image_buffer;
+    if (components == 3) {
+        for (size_t i = 0; i < pixels; i++, p += 3) {
+            p[0] = lut[0][p[0]];
+            p[1] = lut[1][p[1]];
+            p[2] = lut[2][p[2]];
+        }
+    } else {
+        for (size_t i = 0; i < pixels; i++, p++) {
+            p[0] = lut[0][p[0]];
+        }
+    }
+
+    return 0;
+}
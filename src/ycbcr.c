@@ -0,0 +1,412 @@
+/* ycbcr.c */
+
+#include "ycbcr.h"
+#include "simd.h"
+
+/*
+ *  JFIF color conversion constants in 14-bit fixed point (luma ones live in simd.h).
+ *  Each set of forward chroma coefficients sums to 0, so results stay in range without clamping.
+ */
+#define FIX_CB_R    -2765
+#define FIX_CB_G    -5427
+#define FIX_CB_B     8192
+#define FIX_CR_R     8192
+#define FIX_CR_G    -6860
+#define FIX_CR_B    -1332
+#define FIX_R_CR    22970       // 1.402
+#define FIX_G_CB    -5638       // -0.344136
+#define FIX_G_CR   -11700       // -0.714136
+#define FIX_B_CB    29032       // 1.772
+
+#define CHROMA_BIAS ((128 << 16) + (1 << 15))   // offset and rounding for a 2x2 sum (4x scale)
+
+static inline uint8_t clamp_byte(int v) {
+    return (uint8_t)(v < 0 ? 0 : (v > 255 ? 255 : v));
+}
+
+/**
+ *  This function allocates YCbCr 4:2:0 planes of a given number of rows.
+ *      @param img      - YCbCrImage struct to populate
+ *      @param width    - width in pixels of image
+ *      @param height   - height in pixels of image
+ *      @param rows     - luma rows to hold (a multiple of 16)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+static int alloc_planes(YCbCrImage *img, int width, int height, int rows) {
+    memset(img, 0, sizeof(YCbCrImage));
+    if (width <= 0 || height <= 0) {
+        fprintf(stderr, "Invalid dimensions for YCbCr image\n");
+        return -1;
+    }
+
+    img->width          = width;
+    img->height         = height;
+    img->lumaStride     = (width + YCBCR_ROW_GROUP - 1) / YCBCR_ROW_GROUP * YCBCR_ROW_GROUP;
+    img->lumaRows       = rows;
+    img->chromaStride   = img->lumaStride / 2;
+    img->chromaRows     = img->lumaRows / 2;
+
+    img->y  = (uint8_t *)malloc((size_t)img->lumaStride * img->lumaRows);
+    img->cb = (uint8_t *)malloc((size_t)img->chromaStride * img->chromaRows);
+    img->cr = (uint8_t *)malloc((size_t)img->chromaStride * img->chromaRows);
+    if (!img->y || !img->cb || !img->cr) {
+        fprintf(stderr, "Failed to allocate memory for YCbCr planes\n");
+        ycbcr_free(img);
+        return -1;
+    }
+    return 0;
+}
+
+/**
+ *  This function allocates the planes of a YCbCr 4:2:0 image.
+ *      @param img      - YCbCrImage struct to populate
+ *      @param width    - width in pixels of image
+ *      @param height   - height in pixels of image
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int ycbcr_alloc(YCbCrImage *img, int width, int height) {
+    return alloc_planes(img, width, height, (height + YCBCR_ROW_GROUP - 1) / YCBCR_ROW_GROUP * YCBCR_ROW_GROUP);
+}
+
+/**
+ *  This function allocates planes for a single iMCU row (16 luma rows) of
+ *  a YCbCr 4:2:0 image, so an image can be converted and compressed one
+ *  row group at a time. Set rowOffset to the first image row of the group
+ *  before filling the planes.
+ *      @param img      - YCbCrImage struct to populate
+ *      @param width    - width in pixels of image
+ *      @param height   - height in pixels of the whole image
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int ycbcr_alloc_group(YCbCrImage *img, int width, int height) {
+    return alloc_planes(img, width, height, YCBCR_ROW_GROUP);
+}
+
+/**
+ *  This function releases the planes of a YCbCr image.
+ *      @param img      - YCbCrImage struct to release
+ */
+void ycbcr_free(YCbCrImage *img) {
+    free(img->y);
+    free(img->cb);
+    free(img->cr);
+    img->y  = NULL;
+    img->cb = NULL;
+    img->cr = NULL;
+}
+
+#ifdef __SSE2__
+/* 8 chroma values (16-bit) from 8 sums of 2x2 R, G, B blocks */
+static inline __m128i chroma8(__m128i sr, __m128i sg, __m128i sb, __m128i kRG, __m128i kB) {
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i bias = _mm_set1_epi32(CHROMA_BIAS);
+    __m128i lo = _mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(sr, sg), kRG), _mm_madd_epi16(_mm_unpacklo_epi16(sb, zero), kB));
+    __m128i hi = _mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(sr, sg), kRG), _mm_madd_epi16(_mm_unpackhi_epi16(sb, zero), kB));
+    return _mm_packs_epi32(_mm_srai_epi32(_mm_add_epi32(lo, bias), 16), _mm_srai_epi32(_mm_add_epi32(hi, bias), 16));
+}
+#endif
+
+/**
+ *  This function converts a 16x2 block of BGR pixels into 32 luma samples
+ *  and one 8x1 row each of Cb and Cr (the average of every 2x2 square).
+ *      @param p0, p1   - 48 bytes of BGR pixel data from the upper and lower row
+ *      @param y0, y1   - 16 luma outputs for the upper and lower row
+ *      @param cb, cr   - 8 chroma outputs each
+ */
+static void bgr_block_to_ycbcr(const uint8_t *p0, const uint8_t *p1, uint8_t *y0, uint8_t *y1, uint8_t *cb, uint8_t *cr) {
+#ifdef __SSE2__
+    const __m128i kCbRG = _mm_set_epi16(FIX_CB_G, FIX_CB_R, FIX_CB_G, FIX_CB_R, FIX_CB_G, FIX_CB_R, FIX_CB_G, FIX_CB_R);
+    const __m128i kCrRG = _mm_set_epi16(FIX_CR_G, FIX_CR_R, FIX_CR_G, FIX_CR_R, FIX_CR_G, FIX_CR_R, FIX_CR_G, FIX_CR_R);
+    const __m128i kCbB  = _mm_set_epi16(0, FIX_CB_B, 0, FIX_CB_B, 0, FIX_CB_B, 0, FIX_CB_B);
+    const __m128i kCrB  = _mm_set_epi16(0, FIX_CR_B, 0, FIX_CR_B, 0, FIX_CR_B, 0, FIX_CR_B);
+    __m128i e0[3], o0[3], e1[3], o1[3];     // [0] = B, [1] = G, [2] = R
+
+    deinterleave16(p0, e0, o0);
+    deinterleave16(p1, e1, o1);
+
+    /* Luma for even and odd pixels, re-interleaved as bytes */
+    __m128i vy0 = _mm_or_si128(luma8(e0[2], e0[1], e0[0]), _mm_slli_epi16(luma8(o0[2], o0[1], o0[0]), 8));
+    __m128i vy1 = _mm_or_si128(luma8(e1[2], e1[1], e1[0]), _mm_slli_epi16(luma8(o1[2], o1[1], o1[0]), 8));
+    _mm_storeu_si128((__m128i *)y0, vy0);
+    _mm_storeu_si128((__m128i *)y1, vy1);
+
+    /* Even + odd pixels of both rows are exactly the 2x2 sums */
+    __m128i sb = _mm_add_epi16(_mm_add_epi16(e0[0], o0[0]), _mm_add_epi16(e1[0], o1[0]));
+    __m128i sg = _mm_add_epi16(_mm_add_epi16(e0[1], o0[1]), _mm_add_epi16(e1[1], o1[1]));
+    __m128i sr = _mm_add_epi16(_mm_add_epi16(e0[2], o0[2]), _mm_add_epi16(e1[2], o1[2]));
+    __m128i vcb = chroma8(sr, sg, sb, kCbRG, kCbB);
+    __m128i vcr = chroma8(sr, sg, sb, kCrRG, kCrB);
+    _mm_storel_epi64((__m128i *)cb, _mm_packus_epi16(vcb, vcb));
+    _mm_storel_epi64((__m128i *)cr, _mm_packus_epi16(vcr, vcr));
+#else
+    for (int x = 0; x < 16; x++) {
+        const uint8_t *a = p0 + 3 * x;
+        const uint8_t *b = p1 + 3 * x;
+        y0[x] = (uint8_t)((FIX_Y_R * a[2] + FIX_Y_G * a[1] + FIX_Y_B * a[0] + ROUND_14) >> 14);
+        y1[x] = (uint8_t)((FIX_Y_R * b[2] + FIX_Y_G * b[1] + FIX_Y_B * b[0] + ROUND_14) >> 14);
+    }
+    for (int x = 0; x < 16; x += 2) {
+        const uint8_t *a = p0 + 3 * x;
+        const uint8_t *b = p1 + 3 * x;
+        int sb = a[0] + a[3] + b[0] + b[3];
+        int sg = a[1] + a[4] + b[1] + b[4];
+        int sr = a[2] + a[5] + b[2] + b[5];
+        cb[x / 2] = clamp_byte((FIX_CB_R * sr + FIX_CB_G * sg + FIX_CB_B * sb + CHROMA_BIAS) >> 16);
+        cr[x / 2] = clamp_byte((FIX_CR_R * sr + FIX_CR_G * sg + FIX_CR_B * sb + CHROMA_BIAS) >> 16);
+    }
+#endif
+}
+
+/**
+ *  This function copies the tail of a row into a 16-pixel block,
+ *  replicating the last pixel of the row to fill it.
+ *      @param row      - BGR pixel data for the row
+ *      @param x        - first pixel of the block
+ *      @param width    - width in pixels of the row
+ *      @param block    - 48-byte block to fill
+ */
+static void fill_edge_block(const uint8_t *row, int x, int width, uint8_t *block) {
+    for (int i = 0; i < 16; i++) {
+        int src = (x + i < width) ? x + i : width - 1;
+        memcpy(block + 3 * i, row + 3 * src, 3);
+    }
+}
+
+/**
+ *  This function converts BMP-ordered BGR pixel data directly into
+ *  YCbCr 4:2:0 planes. The BGR swizzle, color conversion and chroma
+ *  downsampling are done on 16x2 blocks, so each source row is read once.
+ *  Rows past the bottom and columns past the right edge of the image are
+ *  filled by replicating the last row/column, as libjpeg expects.
+ *      @param pixelData    - BGR pixel data, 3 * width bytes per row (as returned by get_bmp_pixeldata)
+ *      @param bottomUp     - non-zero if pixelData rows are stored bottom to top (BMP file order)
+ *      @param img          - allocated YCbCrImage to fill
+ *      @param firstRow     - first luma row to produce (must be even)
+ *      @param numRows      - number of luma rows to produce (clipped to the padded image and the rows img holds)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int bgr_to_ycbcr420(const uint8_t *pixelData, int bottomUp, YCbCrImage *img, int firstRow, int numRows) {
+    if (firstRow & 1) {
+        fprintf(stderr, "YCbCr conversion must start on an even row\n");
+        return -1;
+    }
+    if (firstRow < img->rowOffset) {
+        fprintf(stderr, "YCbCr conversion rows are not held in the planes\n");
+        return -1;
+    }
+
+    size_t rowBytes = (size_t)img->width * 3;
+    int paddedRows  = (img->height + YCBCR_ROW_GROUP - 1) / YCBCR_ROW_GROUP * YCBCR_ROW_GROUP;
+    int lastRow = firstRow + numRows;
+    if (lastRow > paddedRows) lastRow = paddedRows;
+    if (lastRow > img->rowOffset + img->lumaRows) lastRow = img->rowOffset + img->lumaRows;
+
+    uint8_t edge0[48];
+    uint8_t edge1[48];
+    for (int y = firstRow; y < lastRow; y += 2) {
+        int y0 = (y < img->height) ? y : img->height - 1;
+        int y1 = (y + 1 < img->height) ? y + 1 : img->height - 1;
+        if (bottomUp) {
+            y0 = img->height - 1 - y0;
+            y1 = img->height - 1 - y1;
+        }
+
+        const uint8_t *row0 = pixelData + y0 * rowBytes;
+        const uint8_t *row1 = pixelData + y1 * rowBytes;
+        int planeRow        = y - img->rowOffset;
+        uint8_t *lumaOut    = img->y + (size_t)planeRow * img->lumaStride;
+        uint8_t *cbOut      = img->cb + (size_t)(planeRow / 2) * img->chromaStride;
+        uint8_t *crOut      = img->cr + (size_t)(planeRow / 2) * img->chromaStride;
+
+        for (int x = 0; x < img->lumaStride; x += 16) {
+            const uint8_t *p0 = row0 + 3 * x;
+            const uint8_t *p1 = row1 + 3 * x;
+            if (x + 16 > img->width) {
+                fill_edge_block(row0, x, img->width, edge0);
+                fill_edge_block(row1, x, img->width, edge1);
+                p0 = edge0;
+                p1 = edge1;
+            }
+            bgr_block_to_ycbcr(p0, p1, lumaOut + x, lumaOut + img->lumaStride + x, cbOut + x / 2, crOut + x / 2);
+        }
+    }
+
+    return 0;
+}
+
+/**
+ *  This function filters two chroma rows vertically for libjpeg's h2v2
+ *  "fancy" upsampling: 3 * nearer row + 1 * further row, kept at 4x scale.
+ *      @param near     - chroma row closest to the output row
+ *      @param far      - the other neighbouring chroma row
+ *      @param sums     - 16-bit column sums to fill
+ *      @param count    - number of columns (a multiple of 8)
+ */
+static void chroma_column_sums(const uint8_t *near, const uint8_t *far, int16_t *sums, int count) {
+    int i = 0;
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    for (; i + 8 <= count; i += 8) {
+        __m128i n = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(near + i)), zero);
+        __m128i f = _mm_unpacklo_epi8(_mm_loadl_epi64((const __m128i *)(far + i)), zero);
+        _mm_storeu_si128((__m128i *)(sums + i), _mm_add_epi16(_mm_add_epi16(n, _mm_add_epi16(n, n)), f));
+    }
+#endif
+    for (; i < count; i++) {
+        sums[i] = (int16_t)(3 * near[i] + far[i]);
+    }
+}
+
+#ifdef __SSE2__
+/* Chroma contributions to R, G and B for 8 pixels, from 16-bit Cb and Cr (already minus 128) */
+static inline void chroma_terms8(__m128i vcb, __m128i vcr, __m128i *dr, __m128i *dg, __m128i *db) {
+    const __m128i one   = _mm_set1_epi16(1);
+    const __m128i round = _mm_set1_epi32(ROUND_14);
+    const __m128i kR    = _mm_set_epi16(ROUND_14, FIX_R_CR, ROUND_14, FIX_R_CR, ROUND_14, FIX_R_CR, ROUND_14, FIX_R_CR);
+    const __m128i kB    = _mm_set_epi16(ROUND_14, FIX_B_CB, ROUND_14, FIX_B_CB, ROUND_14, FIX_B_CB, ROUND_14, FIX_B_CB);
+    const __m128i kG    = _mm_set_epi16(FIX_G_CR, FIX_G_CB, FIX_G_CR, FIX_G_CB, FIX_G_CR, FIX_G_CB, FIX_G_CR, FIX_G_CB);
+
+    *dr = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vcr, one), kR), 14),
+        _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vcr, one), kR), 14));
+    *db = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vcb, one), kB), 14),
+        _mm_srai_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vcb, one), kB), 14));
+    *dg = _mm_packs_epi32(
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpacklo_epi16(vcb, vcr), kG), round), 14),
+        _mm_srai_epi32(_mm_add_epi32(_mm_madd_epi16(_mm_unpackhi_epi16(vcb, vcr), kG), round), 14));
+}
+
+/* 16 upsampled chroma samples (two vectors of 8, 16-bit, minus 128) from the column sums of 8 chroma samples */
+static inline void upsample16(const int16_t *sums, __m128i *lo, __m128i *hi) {
+    const __m128i c128  = _mm_set1_epi16(128);
+    const __m128i eight = _mm_set1_epi16(8);
+    const __m128i seven = _mm_set1_epi16(7);
+    __m128i cur  = _mm_loadu_si128((const __m128i *)sums);
+    __m128i prev = _mm_loadu_si128((const __m128i *)(sums - 1));
+    __m128i next = _mm_loadu_si128((const __m128i *)(sums + 1));
+    __m128i cur3 = _mm_add_epi16(cur, _mm_add_epi16(cur, cur));
+    __m128i even = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, prev), eight), 4);
+    __m128i odd  = _mm_srli_epi16(_mm_add_epi16(_mm_add_epi16(cur3, next), seven), 4);
+    *lo = _mm_sub_epi16(_mm_unpacklo_epi16(even, odd), c128);
+    *hi = _mm_sub_epi16(_mm_unpackhi_epi16(even, odd), c128);
+}
+#endif
+
+/**
+ *  This function converts 16 luma samples into 16 BGR pixels, upsampling
+ *  chroma horizontally from vertically filtered column sums the way
+ *  libjpeg's h2v2 fancy upsampler does: 3 * nearer + 1 * further column.
+ *      @param y        - 16 luma samples
+ *      @param cbSums   - column sums of the block's 8 Cb samples (sums[-1] and sums[8] are read too)
+ *      @param crSums   - column sums of the block's 8 Cr samples (sums[-1] and sums[8] are read too)
+ *      @param out      - 48 bytes of BGR pixel data to fill
+ */
+static void ycbcr_block_to_bgr(const uint8_t *y, const int16_t *cbSums, const int16_t *crSums, uint8_t *out) {
+#ifdef __SSE2__
+    const __m128i zero = _mm_setzero_si128();
+    __m128i cbLo, cbHi, crLo, crHi;
+    __m128i dr[2], dg[2], db[2];
+
+    upsample16(cbSums, &cbLo, &cbHi);
+    upsample16(crSums, &crLo, &crHi);
+    chroma_terms8(cbLo, crLo, &dr[0], &dg[0], &db[0]);
+    chroma_terms8(cbHi, crHi, &dr[1], &dg[1], &db[1]);
+
+    __m128i vy   = _mm_loadu_si128((const __m128i *)y);
+    __m128i yLo  = _mm_unpacklo_epi8(vy, zero);
+    __m128i yHi  = _mm_unpackhi_epi8(vy, zero);
+    __m128i r = _mm_packus_epi16(_mm_add_epi16(yLo, dr[0]), _mm_add_epi16(yHi, dr[1]));
+    __m128i g = _mm_packus_epi16(_mm_add_epi16(yLo, dg[0]), _mm_add_epi16(yHi, dg[1]));
+    __m128i b = _mm_packus_epi16(_mm_add_epi16(yLo, db[0]), _mm_add_epi16(yHi, db[1]));
+
+    interleave16(b, g, r, out);
+#else
+    for (int x = 0; x < 16; x++, out += 3) {
+        int i = x / 2;
+        int vcb, vcr;
+        if (x & 1) {
+            vcb = ((3 * cbSums[i] + cbSums[i + 1] + 7) >> 4) - 128;
+            vcr = ((3 * crSums[i] + crSums[i + 1] + 7) >> 4) - 128;
+        } else {
+            vcb = ((3 * cbSums[i] + cbSums[i - 1] + 8) >> 4) - 128;
+            vcr = ((3 * crSums[i] + crSums[i - 1] + 8) >> 4) - 128;
+        }
+        out[0] = clamp_byte(y[x] + ((FIX_B_CB * vcb + ROUND_14) >> 14));
+        out[1] = clamp_byte(y[x] + ((FIX_G_CB * vcb + FIX_G_CR * vcr + ROUND_14) >> 14));
+        out[2] = clamp_byte(y[x] + ((FIX_R_CR * vcr + ROUND_14) >> 14));
+    }
+#endif
+}
+
+/**
+ *  This function converts YCbCr 4:2:0 planes directly into BMP-ordered
+ *  BGR pixel data, upsampling chroma and swizzling in the same pass.
+ *  Chroma is upsampled with libjpeg's h2v2 triangle ("fancy") filter,
+ *  replicating edge rows and columns, so the output matches a normal
+ *  libjpeg decode up to color conversion rounding.
+ *      @param img          - YCbCrImage to convert (whole image, rowOffset 0)
+ *      @param pixelData    - BGR pixel data to fill, 3 * width bytes per row (as expected by save_as_bmp)
+ *      @param bottomUp     - non-zero if pixelData rows are stored bottom to top (BMP file order)
+ *      @param firstRow     - first image row to produce
+ *      @param numRows      - number of image rows to produce (clipped to img->height)
+ *
+ *      @return success of operation: -1 -> failure, 0 -> success
+ */
+int ycbcr420_to_bgr(const YCbCrImage *img, uint8_t *pixelData, int bottomUp, int firstRow, int numRows) {
+    size_t rowBytes     = (size_t)img->width * 3;
+    int chromaWidth     = (img->width + 1) / 2;
+    int chromaHeight    = (img->height + 1) / 2;
+    int lastRow = firstRow + numRows;
+    if (lastRow > img->height) lastRow = img->height;
+    if (img->rowOffset != 0 || img->lumaRows < img->height) {
+        fprintf(stderr, "Chroma upsampling needs the planes of the whole image\n");
+        return -1;
+    }
+
+    /* Column sums with one replicated column on each side */
+    int16_t *cbSums = (int16_t *)malloc((img->chromaStride + 2) * sizeof(int16_t));
+    int16_t *crSums = (int16_t *)malloc((img->chromaStride + 2) * sizeof(int16_t));
+    if (!cbSums || !crSums) {
+        fprintf(stderr, "Failed to allocate memory for chroma upsampling\n");
+        free(cbSums);
+        free(crSums);
+        return -1;
+    }
+
+    uint8_t edge[48];
+    for (int y = firstRow; y < lastRow; y++) {
+        /* Each output row is 3/4 its own chroma row and 1/4 the next one away from it */
+        int near = y / 2;
+        int far  = (y & 1) ? near + 1 : near - 1;
+        if (far < 0) far = 0;
+        if (far >= chromaHeight) far = chromaHeight - 1;
+
+        chroma_column_sums(img->cb + (size_t)near * img->chromaStride, img->cb + (size_t)far * img->chromaStride, cbSums + 1, img->chromaStride);
+        chroma_column_sums(img->cr + (size_t)near * img->chromaStride, img->cr + (size_t)far * img->chromaStride, crSums + 1, img->chromaStride);
+        cbSums[0] = cbSums[1];
+        crSums[0] = crSums[1];
+        cbSums[chromaWidth + 1] = cbSums[chromaWidth];
+        crSums[chromaWidth + 1] = crSums[chromaWidth];
+
+        const uint8_t *lumaIn = img->y + (size_t)y * img->lumaStride;
+        uint8_t *out = pixelData + (bottomUp ? img->height - 1 - y : y) * rowBytes;
+
+        int x = 0;
+        for (; x + 16 <= img->width; x += 16) {
+            ycbcr_block_to_bgr(lumaIn + x, cbSums + 1 + x / 2, crSums + 1 + x / 2, out + 3 * x);
+        }
+        if (x < img->width) {
+            ycbcr_block_to_bgr(lumaIn + x, cbSums + 1 + x / 2, crSums + 1 + x / 2, edge);   // planes are padded to 16
+            memcpy(out + 3 * x, edge, 3 * (img->width - x));
+        }
+    }
+
+    free(cbSums);
+    free(crSums);
+    return 0;
+}